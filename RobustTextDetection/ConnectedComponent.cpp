@@ -7,14 +7,16 @@
 //
 
 #include "ConnectedComponent.h"
+#include "TraceRecorder.h"
 #include <stdexcept>
 
 using namespace std;
 using namespace cv;
 
-ConnectedComponent::ConnectedComponent( int max_component, int connectivity_type )
+ConnectedComponent::ConnectedComponent( int max_component, int connectivity_type, bool compute_solidity )
 : maxComponent( max_component ),
-connectivityType( connectivity_type ){
+connectivityType( connectivity_type ),
+computeSolidity( compute_solidity ){
 }
 
 ConnectedComponent::~ConnectedComponent(){
@@ -27,16 +29,26 @@ ConnectedComponent::~ConnectedComponent(){
  * and currently treat black color as background
  */
 Mat ConnectedComponent::apply( const Mat& image ) {
+    return apply( image, properties );
+}
+
+/**
+ * Same as above, but the properties of the components are returned in props instead of being kept
+ * in this instance. All the state is local to the call, so it's safe to share one instance across threads
+ */
+Mat ConnectedComponent::apply( const Mat& image, vector<ComponentProperty>& props ) const {
     CV_Assert( !image.empty() );
     CV_Assert( image.channels() == 1 );
     
+    TraceSpan span( "connected_component" );
+    
     /* Padding the image with 1 pixel border, just to remove boundary checks */
     Mat result( image.rows + 2, image.cols + 2, image.type(), Scalar(0) );
     image.copyTo( Mat( result, Rect(1, 1, image.cols, image.rows) ) );
     result.convertTo( result, CV_32SC1 );
     
     /* First pass: labeling the regions incrementally */
-    nextLabel = 1;
+    int next_label = 1;
     vector<int> linked(maxComponent);
     
     
@@ -72,12 +84,12 @@ Mat ConnectedComponent::apply( const Mat& image ) {
                     }
                     else {
                         /* If it's new unconnected blob */
-                        curr_ptr[x] = nextLabel;
-                        nextLabel++;
+                        curr_ptr[x] = next_label;
+                        next_label++;
                         
-                        if( nextLabel >= maxComponent ) {
+                        if( next_label >= maxComponent ) {
                             stringstream ss;
-                            ss  << "Current label count [" << (int) nextLabel
+                            ss  << "Current label count [" << next_label
                             << "] exceeds maximum no of components [" << maxComponent << "]";
                             throw std::runtime_error( ss.str() );
                         }
@@ -104,14 +116,14 @@ Mat ConnectedComponent::apply( const Mat& image ) {
     result = Mat( result, Rect(1, 1, image.cols, image.rows) );
     
     /* Second pass: merge the equivalent labels */
-    nextLabel = 1;
+    next_label = 1;
     vector<int> temp, labels_set(maxComponent);
     for( int y = 0; y < result.rows; y++ ) {
         int * curr_ptr = result.ptr<int>(y);
         
         for( int x = 0; x < result.cols; x++ ) {
             if( curr_ptr[x] != 0 ) {
-                curr_ptr[x] = disjointFind( curr_ptr[x], linked, labels_set );
+                curr_ptr[x] = disjointFind( curr_ptr[x], linked, labels_set, next_label );
                 temp.push_back( curr_ptr[x] );
             }
         }
@@ -126,17 +138,23 @@ Mat ConnectedComponent::apply( const Mat& image ) {
     }
     
     /* Gather the properties of each blob */
-    properties.resize( labels.size() );
+    props.resize( labels.size() );
     for( int i = 0; i < labels.size(); i++ ) {
         Mat blob        = result == labels[i];
         
         Moments moment  = cv::moments( blob );
         
-        properties[i].labelID   = labels[i];
-        properties[i].area      = countNonZero( blob );
+        props[i].labelID   = labels[i];
+        props[i].area      = countNonZero( blob );
+        
+        props[i].eccentricity = calculateBlobEccentricity( moment );
+        props[i].centroid     = calculateBlobCentroid( moment );
         
-        properties[i].eccentricity = calculateBlobEccentricity( moment );
-        properties[i].centroid     = calculateBlobCentroid( moment );
+        /* Finding the convex hull is expensive, when skipped every blob is considered solid */
+        if( !computeSolidity ) {
+            props[i].solidity = 1.0;
+            continue;
+        }
         
         /* Find the solidity of the blob from blob area / convex area */
         vector<vector<Point>> contours;
@@ -147,13 +165,13 @@ Mat ConnectedComponent::apply( const Mat& image ) {
             convexHull( contours[0], hull[0] );
             
             /* ... I hope this is correct ... */
-            properties[i].solidity = properties[i].area / contourArea( hull[0] );
+            props[i].solidity = props[i].area / contourArea( hull[0] );
         }
     }
     
     
     /* By default, sort the properties from the area size in descending order */
-    sort( properties.begin(), properties.end(), [=](ComponentProperty& a, ComponentProperty& b){
+    sort( props.begin(), props.end(), [=](ComponentProperty& a, ComponentProperty& b){
         return a.area > b.area;
     });
     
@@ -166,7 +184,7 @@ Mat ConnectedComponent::apply( const Mat& image ) {
  * It's implemented based on the formula shown on http://en.wikipedia.org/wiki/Image_moment#Examples_2
  * which includes using the blob's central moments to find the eigenvalues
  */
-float ConnectedComponent::calculateBlobEccentricity( const Moments& moment ) {
+float ConnectedComponent::calculateBlobEccentricity( const Moments& moment ) const {
     double left_comp  = (moment.nu20 + moment.nu02) / 2.0;
     double right_comp = sqrt( (4 * moment.nu11 * moment.nu11) + (moment.nu20 - moment.nu02)*(moment.nu20 - moment.nu02) ) / 2.0;
     
@@ -179,7 +197,7 @@ float ConnectedComponent::calculateBlobEccentricity( const Moments& moment ) {
 /**
  * From the given blob moment, calculate its centroid
  */
-Point2f ConnectedComponent::calculateBlobCentroid( const Moments& moment ) {
+Point2f ConnectedComponent::calculateBlobCentroid( const Moments& moment ) const {
     return Point2f( moment.m10 / moment.m00, moment.m01 / moment.m00 );
 }
 
@@ -198,7 +216,7 @@ const vector<ComponentProperty>& ConnectedComponent::getComponentsProperties() {
  * Disjoint set union function, taken from
  * https://courses.cs.washington.edu/courses/cse576/02au/homework/hw3/ConnectComponent.java
  */
-void ConnectedComponent::disjointUnion( int a, int b, vector<int>& parent  ) {
+void ConnectedComponent::disjointUnion( int a, int b, vector<int>& parent  ) const {
     while( parent[a] > 0 )
         a = parent[a];
     while( parent[b] > 0 )
@@ -216,11 +234,11 @@ void ConnectedComponent::disjointUnion( int a, int b, vector<int>& parent  ) {
  * Disjoint set find function, taken from
  * https://courses.cs.washington.edu/courses/cse576/02au/homework/hw3/ConnectComponent.java
  */
-int ConnectedComponent::disjointFind( int a, vector<int>& parent, vector<int>& labels ) {
+int ConnectedComponent::disjointFind( int a, vector<int>& parent, vector<int>& labels, int& next_label ) const {
     while( parent[a] > 0 )
         a = parent[a];
     if( labels[a] == 0 )
-        labels[a] = nextLabel++;
+        labels[a] = next_label++;
     return labels[a];
 }
 
@@ -232,7 +250,7 @@ int ConnectedComponent::disjointFind( int a, vector<int>& parent, vector<int>& l
  *
  * returns a vector of that contains unique neighbor labels
  */
-vector<int> ConnectedComponent::get8Neighbors( int * curr_ptr, int * prev_ptr, int x ) {
+vector<int> ConnectedComponent::get8Neighbors( int * curr_ptr, int * prev_ptr, int x ) const {
     vector<int> neighbors;
     
     /* Actually we only consider pixel 1, 2, 3, and 4 */
@@ -263,7 +281,7 @@ vector<int> ConnectedComponent::get8Neighbors( int * curr_ptr, int * prev_ptr, i
 /**
  * Similar to the 8 neighbors, but now only considering two pixels (the top and left ones)
  */
-vector<int> ConnectedComponent::get4Neighbors( int * curr_ptr, int * prev_ptr, int x ) {
+vector<int> ConnectedComponent::get4Neighbors( int * curr_ptr, int * prev_ptr, int x ) const {
     vector<int> neighbors;
     
     /* Actually we only consider pixel 1, 2, 3, and 4 */
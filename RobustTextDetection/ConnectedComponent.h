@@ -42,28 +42,29 @@ struct ComponentProperty {
  */
 class ConnectedComponent {
 public:
-    ConnectedComponent( int max_component = 1000, int connectivity_type = 8 );
+    ConnectedComponent( int max_component = 1000, int connectivity_type = 8, bool compute_solidity = true );
     virtual ~ConnectedComponent();
     
     cv::Mat apply( const cv::Mat& image );
+    cv::Mat apply( const cv::Mat& image, std::vector<ComponentProperty>& props ) const;
     
     int getComponentsCount();
     const std::vector<ComponentProperty>& getComponentsProperties();
     
-    std::vector<int> get8Neighbors( int * curr_ptr, int * prev_ptr, int x );
-    std::vector<int> get4Neighbors( int * curr_ptr, int * prev_ptr, int x );
+    std::vector<int> get8Neighbors( int * curr_ptr, int * prev_ptr, int x ) const;
+    std::vector<int> get4Neighbors( int * curr_ptr, int * prev_ptr, int x ) const;
     
 protected:
-    float calculateBlobEccentricity( const cv::Moments& moment );
-    cv::Point2f calculateBlobCentroid( const cv::Moments& moment );
+    float calculateBlobEccentricity( const cv::Moments& moment ) const;
+    cv::Point2f calculateBlobCentroid( const cv::Moments& moment ) const;
     
-    void disjointUnion( int a, int b, std::vector<int>& parent  );
-    int disjointFind( int a, std::vector<int>& parent, std::vector<int>& labels  );
+    void disjointUnion( int a, int b, std::vector<int>& parent  ) const;
+    int disjointFind( int a, std::vector<int>& parent, std::vector<int>& labels, int& next_label ) const;
     
 private:
     int connectivityType;
     int maxComponent;
-    int nextLabel;
+    bool computeSolidity;
     std::vector<ComponentProperty> properties;
 };
 
@@ -0,0 +1,375 @@
+//
+//  DetectionServer.cpp
+//  RobustTextDetection
+//
+
+#include "DetectionServer.h"
+#include "TraceRecorder.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+using namespace cv;
+
+/* Refuse anything larger than this, so a broken client can't make us allocate arbitrary memory */
+static const uint32_t MAX_PAYLOAD_SIZE = 64 * 1024 * 1024;
+
+/* How often (in ms) the acceptor wakes up to check whether it's been asked to stop */
+static const int POLL_INTERVAL = 200;
+
+DetectionServer::DetectionServer( const RobustTextParam& param, const DetectionServerParam& server_param )
+: detector( param ),
+serverParam( server_param ),
+listenFd( -1 ),
+nextRequestId( 0 ),
+stopping( false ),
+draining( false ),
+cache( max( server_param.cacheCapacity, 0 ), server_param.cacheDirectory ) {
+    /* Same pixels only give the same answer with the same params and OCR language */
+    configKey = ResultCache::combine( ResultCache::hashParam( param ),
+                                      ResultCache::hashBytes( server_param.language.data(), server_param.language.size() ) );
+}
+
+DetectionServer::~DetectionServer() {
+    requestStop();
+
+    {
+        lock_guard<mutex> lock( queueMutex );
+        draining = true;
+    }
+    notEmpty.notify_all();
+
+    for( thread& worker: workers ) {
+        if( worker.joinable() )
+            worker.join();
+    }
+
+    if( listenFd >= 0 ) {
+        close( listenFd );
+        unlink( serverParam.socketPath.c_str() );
+    }
+}
+
+/**
+ * Initialize a Tesseract instance per worker once, right here, then bind the listening socket
+ * and spin up the workers. Fails if Tesseract can't be initialized (e.g. missing tessdata or language)
+ */
+bool DetectionServer::start() {
+    CV_Assert( serverParam.workerCount > 0 && serverParam.maxQueueSize > 0 );
+
+    for( int i = 0; i < serverParam.workerCount; i++ ) {
+        unique_ptr<tesseract::TessBaseAPI> tesseract_api( new tesseract::TessBaseAPI() );
+        if( tesseract_api->Init( NULL, serverParam.language.c_str() ) != 0 ) {
+            cerr << "Unable to initialize Tesseract for language " << serverParam.language << endl;
+            tesseractApis.clear();
+            return false;
+        }
+        tesseractApis.push_back( std::move( tesseract_api ) );
+    }
+
+    sockaddr_un address;
+    memset( &address, 0, sizeof(address) );
+    address.sun_family = AF_UNIX;
+
+    if( serverParam.socketPath.size() >= sizeof(address.sun_path) ) {
+        cerr << "Socket path is too long: " << serverParam.socketPath << endl;
+        return false;
+    }
+    strncpy( address.sun_path, serverParam.socketPath.c_str(), sizeof(address.sun_path) - 1 );
+
+    listenFd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( listenFd < 0 ) {
+        cerr << "Unable to create socket: " << strerror( errno ) << endl;
+        return false;
+    }
+
+    /* Remove stale socket file left behind by a previous instance */
+    unlink( serverParam.socketPath.c_str() );
+
+    /* Path requests let clients read any file we can, so only the owner gets to connect */
+    mode_t previous_umask = umask( 0077 );
+    int bound = ::bind( listenFd, reinterpret_cast<sockaddr *>( &address ), sizeof(address) );
+    umask( previous_umask );
+
+    if( bound != 0 || listen( listenFd, serverParam.maxQueueSize ) != 0 ) {
+        cerr << "Unable to listen on " << serverParam.socketPath << ": " << strerror( errno ) << endl;
+        close( listenFd );
+        listenFd = -1;
+        return false;
+    }
+
+    /* Clients hanging up before reading their response shouldn't kill the whole server */
+    signal( SIGPIPE, SIG_IGN );
+
+    for( int i = 0; i < serverParam.workerCount; i++ )
+        workers.push_back( thread( &DetectionServer::workerLoop, this, tesseractApis[i].get() ) );
+
+    return true;
+}
+
+/**
+ * Accept requests until requestStop() is called, then drain the queue and return
+ */
+void DetectionServer::run() {
+    acceptLoop();
+
+    {
+        lock_guard<mutex> lock( queueMutex );
+        draining = true;
+    }
+    notEmpty.notify_all();
+
+    for( thread& worker: workers )
+        worker.join();
+    workers.clear();
+
+    close( listenFd );
+    unlink( serverParam.socketPath.c_str() );
+    listenFd = -1;
+}
+
+/**
+ * Ask the server to stop accepting new requests, only touches an atomic flag
+ * so it's safe to be called from a signal handler
+ */
+void DetectionServer::requestStop() {
+    stopping.store( true );
+}
+
+void DetectionServer::acceptLoop() {
+    while( !stopping.load() ) {
+        /* Backpressure: don't accept anything while the queue is full */
+        {
+            unique_lock<mutex> lock( queueMutex );
+            notFull.wait_for( lock, chrono::milliseconds( POLL_INTERVAL ), [&]{
+                return queue.size() < static_cast<size_t>( serverParam.maxQueueSize );
+            });
+
+            if( queue.size() >= static_cast<size_t>( serverParam.maxQueueSize ) )
+                continue;
+        }
+
+        pollfd poll_fd = { listenFd, POLLIN, 0 };
+        if( poll( &poll_fd, 1, POLL_INTERVAL ) <= 0 )
+            continue;
+
+        int fd = accept( listenFd, NULL, NULL );
+        if( fd < 0 )
+            continue;
+
+        /* Reading the request is left to the workers, so a slow client can't hold up the acceptor */
+        Request request;
+        request.fd = fd;
+        request.id = nextRequestId++;
+
+        {
+            lock_guard<mutex> lock( queueMutex );
+            request.queuedAt = TraceRecorder::now();
+            queue.push_back( std::move( request ) );
+        }
+        notEmpty.notify_one();
+    }
+}
+
+/**
+ * Each worker uses its own Tesseract instance (initialized in start()) for the lifetime of the server,
+ * and takes one request off the queue at a time, so that no request waits behind another while a worker is idle
+ */
+void DetectionServer::workerLoop( tesseract::TessBaseAPI * tesseract_api ) {
+    TraceRecorder& tracer = TraceRecorder::instance();
+
+    while( true ) {
+        Request request;
+        {
+            unique_lock<mutex> lock( queueMutex );
+            notEmpty.wait( lock, [&]{ return !queue.empty() || draining; } );
+
+            /* Only leave once everything queued has been served */
+            if( queue.empty() )
+                break;
+
+            request = std::move( queue.front() );
+            queue.pop_front();
+        }
+        notFull.notify_one();
+
+        TraceRecorder::setImageId( request.id );
+
+        /* Show how long the request sat in the queue */
+        if( tracer.isEnabled() )
+            tracer.record( "queued", request.queuedAt, TraceRecorder::now() );
+
+        if( readRequest( request.fd, request ) )
+            process( request, *tesseract_api );
+        else
+            writeResponse( request.fd, STATUS_BAD_REQUEST, Rect(), "" );
+        close( request.fd );
+    }
+
+    tesseract_api->End();
+}
+
+/**
+ * Run the detection and OCR for a single request, and write back the response
+ */
+void DetectionServer::process( Request& request, tesseract::TessBaseAPI& tesseract_api ) {
+    /* Decoding is fed straight from the client, so it can throw just as well as the detection */
+    try {
+        /* Exact duplicates are answered straight from the cache, only the rect and text are sent back.
+         * Byte identical encoded images are caught before decoding, anything else that decodes to the
+         * same pixels (re-encoded, or a path whose content may have changed) after decoding */
+        bool use_cache = serverParam.cacheCapacity > 0;
+        bool use_payload_key = use_cache && request.type == REQUEST_IMAGE;
+        unsigned long long payload_key = 0;
+        CachedResult cached;
+
+        if( use_payload_key ) {
+            payload_key = ResultCache::combine( ResultCache::hashBytes( request.payload.data(), request.payload.size() ), configKey );
+            if( cache.get( payload_key, cached, false ) ) {
+                writeResponse( request.fd, STATUS_OK, cached.rect, cached.text );
+                return;
+            }
+        }
+
+        Mat image;
+        if( request.type == REQUEST_PATH )
+            image = imread( string( request.payload.begin(), request.payload.end() ) );
+        else
+            image = imdecode( Mat( request.payload ), 1 );
+
+        if( image.empty() ) {
+            writeResponse( request.fd, STATUS_BAD_REQUEST, Rect(), "" );
+            return;
+        }
+
+        unsigned long long key = 0;
+        if( use_cache ) {
+            key = ResultCache::combine( ResultCache::hashImage( image ), configKey );
+            
+            if( cache.get( key, cached, false ) ) {
+                /* Next time these same bytes come in, skip the decoding too */
+                if( use_payload_key )
+                    cache.put( payload_key, cached );
+
+                writeResponse( request.fd, STATUS_OK, cached.rect, cached.text );
+                return;
+            }
+        }
+        
+        pair<Mat, Rect> result = detector.apply( image );
+
+        string text;
+        if( result.second.area() > 0 ) {
+            TraceSpan span( "ocr" );
+            Mat stroke_width = Mat( result.first, result.second ).clone();
+            tesseract_api.SetImage( (uchar*) stroke_width.data, stroke_width.cols, stroke_width.rows, 1, static_cast<int>( stroke_width.step[0] ) );
+
+            char * out = tesseract_api.GetUTF8Text();
+            if( out != NULL ) {
+                text = out;
+                delete [] out;
+            }
+        }
+
+        if( use_cache ) {
+            cached.rect = result.second;
+            cached.mask = result.first;
+            cached.text = text;
+            cache.put( key, cached );
+
+            /* The payload level entry only needs what's sent back, not the mask */
+            if( use_payload_key ) {
+                cached.mask = Mat();
+                cache.put( payload_key, cached );
+            }
+        }
+
+        writeResponse( request.fd, STATUS_OK, result.second, text );
+    }
+    catch( std::exception& e ) {
+        writeResponse( request.fd, STATUS_FAILED, Rect(), e.what() );
+    }
+    catch( ... ) {
+        writeResponse( request.fd, STATUS_FAILED, Rect(), "unknown error" );
+    }
+}
+
+/**
+ * The whole request has to arrive within receiveTimeout, no matter how it's trickled in
+ */
+bool DetectionServer::readRequest( int fd, Request& request ) {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds( serverParam.receiveTimeout );
+
+    uint32_t header[2];
+    if( !readFully( fd, header, sizeof(header), deadline ) )
+        return false;
+
+    request.fd   = fd;
+    request.type = header[0];
+
+    if( (request.type != REQUEST_PATH && request.type != REQUEST_IMAGE) || header[1] == 0 || header[1] > MAX_PAYLOAD_SIZE )
+        return false;
+
+    request.payload.resize( header[1] );
+    return readFully( fd, request.payload.data(), request.payload.size(), deadline );
+}
+
+bool DetectionServer::writeResponse( int fd, int status, const Rect& rect, const string& text ) {
+    int32_t header[5] = { status, rect.x, rect.y, rect.width, rect.height };
+    uint32_t length   = static_cast<uint32_t>( text.size() );
+
+    return  writeFully( fd, header, sizeof(header) ) &&
+            writeFully( fd, &length, sizeof(length) ) &&
+            writeFully( fd, text.data(), text.size() );
+}
+
+/**
+ * Only read what poll() says is already there, so we never block past the deadline
+ */
+bool DetectionServer::readFully( int fd, void * buffer, size_t size, chrono::steady_clock::time_point deadline ) {
+    char * ptr = static_cast<char *>( buffer );
+    while( size > 0 ) {
+        long long remaining = chrono::duration_cast<chrono::milliseconds>( deadline - chrono::steady_clock::now() ).count();
+        if( remaining <= 0 )
+            return false;
+
+        pollfd poll_fd = { fd, POLLIN, 0 };
+        int ready = poll( &poll_fd, 1, static_cast<int>( remaining ) );
+        if( ready < 0 && errno == EINTR )
+            continue;
+        if( ready <= 0 )
+            return false;
+
+        ssize_t count = read( fd, ptr, size );
+        if( count < 0 && errno == EINTR )
+            continue;
+        if( count <= 0 )
+            return false;
+
+        ptr  += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool DetectionServer::writeFully( int fd, const void * buffer, size_t size ) {
+    const char * ptr = static_cast<const char *>( buffer );
+    while( size > 0 ) {
+        ssize_t count = write( fd, ptr, size );
+        if( count < 0 && errno == EINTR )
+            continue;
+        if( count <= 0 )
+            return false;
+
+        ptr  += count;
+        size -= count;
+    }
+    return true;
+}
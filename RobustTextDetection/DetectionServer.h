@@ -0,0 +1,120 @@
+//
+//  DetectionServer.h
+//  RobustTextDetection
+//
+
+#ifndef __RobustTextDetection__DetectionServer__
+#define __RobustTextDetection__DetectionServer__
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include <tesseract/baseapi.h>
+
+#include "RobustTextDetection.h"
+#include "ResultCache.h"
+
+/**
+ * Parameters for the resident detection server
+ */
+struct DetectionServerParam {
+    std::string socketPath  = "/tmp/robust_text_detection.sock";   /* created accessible to the owner only */
+    std::string language    = "eng";
+
+    int workerCount         = 4;
+    int maxQueueSize        = 64;
+    int receiveTimeout      = 5;    /* for the whole request, in seconds */
+    
+    /* Results of exact duplicate images are served from the cache, 0 capacity disables it.
+     * When a directory is given, results are also persisted there across restarts */
+    int cacheCapacity          = 1024;
+    std::string cacheDirectory = "";
+};
+
+
+/**
+ * Long running server that listens on a unix domain socket, so that the process startup, OpenCV
+ * and Tesseract initialization are only paid once. The workers share a single detector, each of them
+ * owns its own Tesseract instance, and pulls requests off a bounded queue one at a time.
+ *
+ * One request per connection, everything in native byte order:
+ *   request  : uint32 type, uint32 length, followed by length bytes of payload
+ *              type 0 - payload is a path to an image file
+ *              type 1 - payload is an encoded image (PNG, JPEG, ...)
+ *   response : int32 status, int32 x, int32 y, int32 width, int32 height,
+ *              uint32 length, followed by length bytes of UTF-8 OCR text
+ *
+ * The acceptor only accepts connections and queues them, reading the request is up to the workers,
+ * within receiveTimeout for the whole request. When the queue is full the acceptor stops accepting,
+ * so that clients get pushed back by the listen backlog instead of us buffering without bound.
+ * On stop, no new connection is accepted, but everything already queued is still processed
+ * before run() returns.
+ */
+class DetectionServer {
+public:
+    enum RequestType {
+        REQUEST_PATH  = 0,
+        REQUEST_IMAGE = 1,
+    };
+
+    enum ResponseStatus {
+        STATUS_OK           = 0,
+        STATUS_BAD_REQUEST  = 1,
+        STATUS_FAILED       = 2,
+    };
+
+    DetectionServer( const RobustTextParam& param, const DetectionServerParam& server_param );
+    virtual ~DetectionServer();
+
+    bool start();
+    void run();
+    void requestStop();
+
+protected:
+    struct Request {
+        int fd;
+        long long id;
+        long long queuedAt;
+        uint32_t type;
+        std::vector<uchar> payload;
+    };
+
+    void acceptLoop();
+    void workerLoop( tesseract::TessBaseAPI * tesseract_api );
+    void process( Request& request, tesseract::TessBaseAPI& tesseract_api );
+
+    bool readRequest( int fd, Request& request );
+    bool writeResponse( int fd, int status, const cv::Rect& rect, const std::string& text );
+
+    static bool readFully( int fd, void * buffer, size_t size, std::chrono::steady_clock::time_point deadline );
+    static bool writeFully( int fd, const void * buffer, size_t size );
+
+private:
+    /* Shared by all the workers, only Tesseract has to be per worker */
+    const RobustTextDetection detector;
+    DetectionServerParam serverParam;
+
+    int listenFd;
+    long long nextRequestId;
+    std::atomic<bool> stopping;
+
+    std::mutex queueMutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<Request> queue;
+    bool draining;
+
+    std::vector<std::unique_ptr<tesseract::TessBaseAPI>> tesseractApis;
+    std::vector<std::thread> workers;
+
+    ResultCache cache;
+    unsigned long long configKey;
+};
+
+#endif /* defined(__RobustTextDetection__DetectionServer__) */
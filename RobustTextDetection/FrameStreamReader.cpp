@@ -0,0 +1,250 @@
+//
+//  FrameStreamReader.cpp
+//  RobustTextDetection
+//
+
+#include "FrameStreamReader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace cv;
+
+/* Number of frames we ask the kernel to page in ahead of the one being processed */
+static const int READ_AHEAD_FRAMES = 4;
+
+FrameStreamReader::FrameStreamReader()
+: fd( -1 ),
+data( NULL ),
+dataSize( 0 ),
+offset( 0 ),
+firstFrameOffset( 0 ),
+frameSize( 0 ),
+chromaSize( 0 ),
+y4m( false ),
+frameIndex( 0 ),
+frameCount( 0 ),
+readAheadSize( 0 ),
+readAheadOffset( 0 ) {
+}
+
+FrameStreamReader::~FrameStreamReader() {
+    close();
+}
+
+/**
+ * Open a YUV4MPEG2 file, only 8 bit formats are supported
+ */
+bool FrameStreamReader::openY4M( const string& filename ) {
+    if( !mapFile( filename ) )
+        return false;
+
+    y4m = true;
+    if( !parseY4MHeader() ) {
+        close();
+        return false;
+    }
+
+    /* Assuming that each frame header is just "FRAME\n", which is what most encoders write */
+    frameCount = static_cast<int>( (dataSize - firstFrameOffset) / (6 + frameSize + chromaSize) );
+    readAheadSize = READ_AHEAD_FRAMES * (6 + frameSize + chromaSize);
+    return true;
+}
+
+/**
+ * Open a file which consists of back to back width x height 8 bit grayscale frames, without any headers
+ */
+bool FrameStreamReader::openRaw( const string& filename, int width, int height ) {
+    CV_Assert( width > 0 && height > 0 );
+
+    if( !mapFile( filename ) )
+        return false;
+
+    y4m              = false;
+    size             = Size( width, height );
+    frameSize        = static_cast<size_t>( width ) * height;
+    chromaSize       = 0;
+    firstFrameOffset = 0;
+    offset           = 0;
+    frameCount       = static_cast<int>( dataSize / frameSize );
+    readAheadSize    = READ_AHEAD_FRAMES * frameSize;
+    return true;
+}
+
+void FrameStreamReader::close() {
+    if( data != NULL )
+        munmap( data, dataSize );
+    if( fd >= 0 )
+        ::close( fd );
+
+    fd              = -1;
+    data            = NULL;
+    dataSize        = 0;
+    offset          = 0;
+    frameIndex      = 0;
+    frameCount      = 0;
+    readAheadOffset = 0;
+}
+
+/**
+ * Get the luma plane of the next frame, as a Mat header pointing into the mapped file.
+ * Returns false when there's no more complete frame left
+ */
+bool FrameStreamReader::next( Mat& luma ) {
+    if( data == NULL )
+        return false;
+
+    if( y4m ) {
+        /* Each frame starts with "FRAME", optionally followed by parameters, and terminated by a newline */
+        if( offset + 5 > dataSize || memcmp( data + offset, "FRAME", 5 ) != 0 )
+            return false;
+
+        const void * newline = memchr( data + offset, '\n', dataSize - offset );
+        if( newline == NULL )
+            return false;
+        offset = static_cast<const unsigned char *>( newline ) - data + 1;
+    }
+
+    if( offset + frameSize > dataSize )
+        return false;
+
+    readAhead( offset + frameSize + chromaSize );
+
+    luma    = Mat( size, CV_8UC1, data + offset );
+    offset += frameSize + chromaSize;
+    frameIndex++;
+    return true;
+}
+
+bool FrameStreamReader::isOpened() const {
+    return data != NULL;
+}
+
+/**
+ * Returns the number of frames read so far
+ */
+int FrameStreamReader::getFrameIndex() const {
+    return frameIndex;
+}
+
+/**
+ * Returns the number of frames in the file, for Y4M this is an estimate
+ * since frame headers are allowed to carry parameters
+ */
+int FrameStreamReader::getFrameCount() const {
+    return frameCount;
+}
+
+Size FrameStreamReader::getFrameSize() const {
+    return size;
+}
+
+/**
+ * Memory map the whole file, and tell the kernel that we're going to read it sequentially
+ */
+bool FrameStreamReader::mapFile( const string& filename ) {
+    close();
+
+    fd = ::open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+        return false;
+
+    struct stat file_stat;
+    if( fstat( fd, &file_stat ) != 0 || file_stat.st_size == 0 ) {
+        close();
+        return false;
+    }
+    dataSize = static_cast<size_t>( file_stat.st_size );
+
+    void * mapped = mmap( NULL, dataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    if( mapped == MAP_FAILED ) {
+        dataSize = 0;
+        close();
+        return false;
+    }
+
+    data = static_cast<unsigned char *>( mapped );
+    madvise( data, dataSize, MADV_SEQUENTIAL );
+    return true;
+}
+
+/**
+ * Parse the stream header, e.g. "YUV4MPEG2 W640 H480 F30:1 Ip A1:1 C420jpeg\n"
+ */
+bool FrameStreamReader::parseY4MHeader() {
+    static const char MAGIC[] = "YUV4MPEG2";
+    if( dataSize < sizeof(MAGIC) - 1 || memcmp( data, MAGIC, sizeof(MAGIC) - 1 ) != 0 )
+        return false;
+
+    const void * newline = memchr( data, '\n', dataSize );
+    if( newline == NULL )
+        return false;
+
+    size_t header_size = static_cast<const unsigned char *>( newline ) - data;
+    string header( reinterpret_cast<const char *>( data ), header_size );
+
+    int width = 0, height = 0;
+    string colorspace = "420jpeg";
+
+    istringstream iss( header.substr( sizeof(MAGIC) - 1 ) );
+    string token;
+    while( iss >> token ) {
+        switch( token[0] ) {
+            case 'W': width      = atoi( token.c_str() + 1 ); break;
+            case 'H': height     = atoi( token.c_str() + 1 ); break;
+            case 'C': colorspace = token.substr( 1 ); break;
+            default: break;
+        }
+    }
+
+    if( width <= 0 || height <= 0 )
+        return false;
+
+    size_t chroma_width  = (width  + 1) / 2;
+    size_t chroma_height = (height + 1) / 2;
+
+    /* We only care about the luma plane, but still need to know how much chroma to skip */
+    if( colorspace == "420" || colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" )
+        chromaSize = 2 * chroma_width * chroma_height;
+    else if( colorspace == "422" )
+        chromaSize = 2 * chroma_width * height;
+    else if( colorspace == "444" )
+        chromaSize = 2 * static_cast<size_t>( width ) * height;
+    else if( colorspace == "444alpha" )
+        chromaSize = 3 * static_cast<size_t>( width ) * height;
+    else if( colorspace == "mono" )
+        chromaSize = 0;
+    else {
+        cerr << "Unsupported Y4M colorspace: " << colorspace << endl;
+        return false;
+    }
+
+    size             = Size( width, height );
+    frameSize        = static_cast<size_t>( width ) * height;
+    firstFrameOffset = header_size + 1;
+    offset           = firstFrameOffset;
+    return true;
+}
+
+/**
+ * Hint the kernel to start paging in the next few frames, while we're busy with the current one
+ */
+void FrameStreamReader::readAhead( size_t from ) {
+    /* Only issue a new hint once we've eaten into half of the previous window */
+    if( from >= dataSize || from + readAheadSize / 2 < readAheadOffset )
+        return;
+
+    /* madvise wants page aligned addresses */
+    static const size_t page_size = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+    size_t start = max( from, readAheadOffset ) & ~(page_size - 1);
+    size_t end   = min( from + readAheadSize, dataSize );
+
+    madvise( data + start, end - start, MADV_WILLNEED );
+    readAheadOffset = end;
+}
@@ -0,0 +1,60 @@
+//
+//  FrameStreamReader.h
+//  RobustTextDetection
+//
+
+#ifndef __RobustTextDetection__FrameStreamReader__
+#define __RobustTextDetection__FrameStreamReader__
+
+#include <iostream>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Reads frames out of a Y4M (YUV4MPEG2) file, or a file of fixed size raw 8 bit grayscale frames,
+ * by memory mapping the whole file. Each frame's luma plane is handed out as a Mat header that
+ * points straight into the mapping, so there's no decoding nor copying per frame.
+ *
+ * The mapping is private (copy on write), so the returned headers can be passed to anything that
+ * expects a writable Mat, but they're only valid until the reader is closed or destroyed.
+ */
+class FrameStreamReader {
+public:
+    FrameStreamReader();
+    virtual ~FrameStreamReader();
+
+    bool openY4M( const std::string& filename );
+    bool openRaw( const std::string& filename, int width, int height );
+    void close();
+
+    bool next( cv::Mat& luma );
+
+    bool isOpened() const;
+    int getFrameIndex() const;
+    int getFrameCount() const;
+    cv::Size getFrameSize() const;
+
+protected:
+    bool mapFile( const std::string& filename );
+    bool parseY4MHeader();
+    void readAhead( size_t from );
+
+private:
+    int fd;
+    unsigned char * data;
+    size_t dataSize;
+
+    size_t offset;
+    size_t firstFrameOffset;
+    size_t frameSize;
+    size_t chromaSize;
+    bool y4m;
+
+    cv::Size size;
+    int frameIndex;
+    int frameCount;
+
+    size_t readAheadSize;
+    size_t readAheadOffset;
+};
+
+#endif /* defined(__RobustTextDetection__FrameStreamReader__) */
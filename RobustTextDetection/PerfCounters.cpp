@@ -0,0 +1,193 @@
+//
+//  PerfCounters.cpp
+//  RobustTextDetection
+//
+
+#include "PerfCounters.h"
+#include "TraceRecorder.h"
+
+#include <cstring>
+#include <iomanip>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+/**
+ * Open a single hardware counter for the calling thread, user space only
+ */
+static int openCounter( unsigned long long config, int group_fd ) {
+    perf_event_attr attr;
+    memset( &attr, 0, sizeof(attr) );
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.disabled       = group_fd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+
+    return static_cast<int>( syscall( __NR_perf_event_open, &attr, 0, -1, group_fd, 0 ) );
+}
+#endif
+
+PerfCounters::PerfCounters()
+: leaderFd( -1 ) {
+    for( int i = 0; i < PerfCounterValues::COUNT; i++ )
+        fds[i] = -1;
+
+#ifdef __linux__
+    static const unsigned long long configs[PerfCounterValues::COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    /* Cycles lead the group, if we can't even have that, don't bother with the rest */
+    leaderFd = fds[0] = openCounter( configs[0], -1 );
+    if( leaderFd < 0 ) {
+        leaderFd = fds[0] = -1;
+        return;
+    }
+
+    /* The rest are optional, some virtual machines only expose part of the events */
+    for( int i = 1; i < PerfCounterValues::COUNT; i++ ) {
+        fds[i] = openCounter( configs[i], leaderFd );
+        if( fds[i] < 0 )
+            fds[i] = -1;
+    }
+
+    ioctl( leaderFd, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP );
+    ioctl( leaderFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+    for( int i = 0; i < PerfCounterValues::COUNT; i++ ) {
+        if( fds[i] >= 0 )
+            close( fds[i] );
+    }
+}
+
+/**
+ * Counters are tied to the thread that opened them, so each thread gets its own group
+ */
+PerfCounters& PerfCounters::threadInstance() {
+    static thread_local PerfCounters counters;
+    return counters;
+}
+
+bool PerfCounters::isAvailable() const {
+    return leaderFd >= 0;
+}
+
+/**
+ * Read the current (running) values of all the counters in the group
+ */
+void PerfCounters::read( PerfCounterValues& values ) const {
+    values = PerfCounterValues();
+    if( leaderFd < 0 )
+        return;
+
+    /* With PERF_FORMAT_GROUP we get { nr, value[nr] }, in the order the counters were opened */
+    unsigned long long buffer[1 + PerfCounterValues::COUNT];
+    if( ::read( leaderFd, buffer, sizeof(buffer) ) < static_cast<ssize_t>( sizeof(unsigned long long) ) )
+        return;
+
+    size_t index = 1;
+    for( int i = 0; i < PerfCounterValues::COUNT && index <= buffer[0]; i++ ) {
+        if( fds[i] < 0 )
+            continue;
+
+        values.values[i]    = buffer[index++];
+        values.available[i] = true;
+    }
+}
+
+
+StageProfiler::StageProfiler( vector<StageProfile>& stages, bool enabled )
+: stages( stages ),
+enabled( enabled ),
+name( NULL ),
+begin( 0 ) {
+}
+
+StageProfiler::~StageProfiler() {
+    end();
+}
+
+/**
+ * Close the current stage (if any), and start measuring the next one
+ */
+void StageProfiler::next( const char * name ) {
+    if( !enabled )
+        return;
+
+    end();
+
+    this->name  = name;
+    this->begin = TraceRecorder::now();
+    PerfCounters::threadInstance().read( beginCounters );
+}
+
+void StageProfiler::end() {
+    if( name == NULL )
+        return;
+
+    StageProfile profile;
+    profile.name = name;
+
+    PerfCounters::threadInstance().read( profile.counters );
+    profile.elapsed = (TraceRecorder::now() - begin) / 1000.0;
+
+    for( int i = 0; i < PerfCounterValues::COUNT; i++ )
+        profile.counters.values[i] -= beginCounters.values[i];
+
+    stages.push_back( profile );
+    name = NULL;
+}
+
+
+/**
+ * Print a table of the stage profiles, in absolute numbers and per megapixel of input
+ */
+ostream& printStageProfiles( ostream& os, const vector<StageProfile>& stages, double megapixels ) {
+    static const char * labels[PerfCounterValues::COUNT] = { "cycles", "instructions", "cache misses", "branch misses" };
+
+    if( megapixels <= 0.0 )
+        megapixels = 1.0;
+
+    for( const StageProfile& stage: stages ) {
+        os  << setw(20) << stage.name << ": " << fixed << setprecision(3) << stage.elapsed << " ms ("
+            << stage.elapsed / megapixels << " ms/MP)\n";
+
+        /* Cycles lead the group, without them there's nothing else either */
+        if( !stage.counters.available[PerfCounterValues::CYCLES] ) {
+            os << setw(22) << "" << "hardware counters unavailable\n";
+            continue;
+        }
+
+        for( int i = 0; i < PerfCounterValues::COUNT; i++ ) {
+            os << setw(22) << "" << setw(14) << labels[i] << ": ";
+            if( stage.counters.available[i] )
+                os << stage.counters.values[i] << " (" << static_cast<unsigned long long>( stage.counters.values[i] / megapixels ) << " /MP)\n";
+            else
+                os << "n/a\n";
+        }
+
+        if( stage.counters.available[PerfCounterValues::CYCLES] && stage.counters.available[PerfCounterValues::INSTRUCTIONS] && stage.counters.values[PerfCounterValues::CYCLES] > 0 ) {
+            os  << setw(22) << "" << setw(14) << "IPC" << ": "
+                << static_cast<double>( stage.counters.values[PerfCounterValues::INSTRUCTIONS] ) / stage.counters.values[PerfCounterValues::CYCLES] << "\n";
+        }
+    }
+
+    os.unsetf( ios::floatfield );
+    return os;
+}
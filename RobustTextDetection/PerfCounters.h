@@ -0,0 +1,91 @@
+//
+//  PerfCounters.h
+//  RobustTextDetection
+//
+
+#ifndef __RobustTextDetection__PerfCounters__
+#define __RobustTextDetection__PerfCounters__
+
+#include <iostream>
+#include <vector>
+
+/**
+ * Hardware counter values, either absolute readings or the difference between two
+ */
+struct PerfCounterValues {
+    enum {
+        CYCLES = 0,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        COUNT,
+    };
+
+    unsigned long long values[COUNT] = { 0, 0, 0, 0 };
+    bool available[COUNT] = { false, false, false, false };
+};
+
+
+/**
+ * Wall clock time and hardware counters spent in one stage of the pipeline
+ */
+struct StageProfile {
+    const char * name;
+    double elapsed;     /* in milliseconds */
+    PerfCounterValues counters;
+};
+
+
+/**
+ * Group of hardware performance counters (cycles, instructions, cache misses, branch misses)
+ * counting the calling thread in user space, using perf_event_open.
+ *
+ * On anything but Linux, or when the kernel doesn't let us have them (e.g. inside containers,
+ * or with a restrictive perf_event_paranoid), the counters are simply reported as unavailable
+ */
+class PerfCounters {
+public:
+    PerfCounters();
+    virtual ~PerfCounters();
+
+    static PerfCounters& threadInstance();
+
+    bool isAvailable() const;
+    void read( PerfCounterValues& values ) const;
+
+private:
+    int leaderFd;
+    int fds[PerfCounterValues::COUNT];
+};
+
+
+/**
+ * Splits a sequential pipeline into stages, and records the elapsed time and counters of each
+ * into the given profile list, e.g.
+ *   StageProfiler profiler( stages, true );
+ *   profiler.next( "mser" );
+ *   ...
+ *   profiler.next( "canny" );
+ * Does nothing at all when not enabled
+ */
+class StageProfiler {
+public:
+    StageProfiler( std::vector<StageProfile>& stages, bool enabled );
+    ~StageProfiler();
+
+    void next( const char * name );
+    void end();
+
+private:
+    std::vector<StageProfile>& stages;
+    bool enabled;
+
+    const char * name;
+    long long begin;
+    PerfCounterValues beginCounters;
+};
+
+
+std::ostream& printStageProfiles( std::ostream& os, const std::vector<StageProfile>& stages, double megapixels );
+
+#endif /* defined(__RobustTextDetection__PerfCounters__) */
@@ -0,0 +1,368 @@
+//
+//  ResultCache.cpp
+//  RobustTextDetection
+//
+
+#include "ResultCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace cv;
+
+/* Header of the on-disk format, bump the version whenever the layout changes */
+static const char CACHE_MAGIC[4]   = { 'R', 'T', 'D', 'C' };
+static const unsigned int CACHE_VERSION = 1;
+
+/* Sanity limits for entries read back from disk, anything beyond is treated as corrupt */
+static const int MAX_DIMENSION            = 32768;
+static const unsigned int MAX_TEXT_LENGTH = 1024 * 1024;
+
+ResultCache::ResultCache( size_t capacity, const string& directory, int shard_count )
+: directory( directory ) {
+    CV_Assert( shard_count > 0 );
+
+    capacityPerShard = max( static_cast<size_t>( 1 ), (capacity + shard_count - 1) / shard_count );
+    for( int i = 0; i < shard_count; i++ )
+        shards.push_back( unique_ptr<Shard>( new Shard() ) );
+}
+
+ResultCache::~ResultCache() {
+}
+
+/**
+ * 64 bit hash of arbitrary bytes, 8 bytes at a time (based on MurmurHash64A)
+ */
+unsigned long long ResultCache::hashBytes( const void * data, size_t size, unsigned long long seed ) {
+    const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    unsigned long long h = seed ^ (size * m);
+
+    const unsigned char * ptr = static_cast<const unsigned char *>( data );
+    const unsigned char * end = ptr + (size & ~static_cast<size_t>( 7 ));
+
+    for( ; ptr != end; ptr += 8 ) {
+        unsigned long long k;
+        memcpy( &k, ptr, sizeof(k) );
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    /* Remaining tail bytes */
+    size_t tail = size & 7;
+    if( tail > 0 ) {
+        unsigned long long k = 0;
+        memcpy( &k, ptr, tail );
+        h ^= k;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+unsigned long long ResultCache::combine( unsigned long long a, unsigned long long b ) {
+    return hashBytes( &b, sizeof(b), a );
+}
+
+/**
+ * Hash of the pixel data, together with the dimensions and type. Works on non continuous Mat too
+ */
+unsigned long long ResultCache::hashImage( const Mat& image ) {
+    int header[3] = { image.rows, image.cols, image.type() };
+    unsigned long long h = hashBytes( header, sizeof(header) );
+
+    if( image.isContinuous() )
+        return hashBytes( image.data, image.total() * image.elemSize(), h );
+
+    size_t row_size = image.cols * image.elemSize();
+    for( int y = 0; y < image.rows; y++ )
+        h = hashBytes( image.ptr(y), row_size, h );
+    return h;
+}
+
+/**
+ * Hash of every parameter that can change the detection result. Fields are hashed one by one,
+ * instead of the raw struct, since padding bytes aren't guaranteed to be anything
+ */
+unsigned long long ResultCache::hashParam( const RobustTextParam& param ) {
+    int int_fields[] = {
+        param.minMSERArea, param.maxMSERArea, param.cannyThresh1, param.cannyThresh2,
+        param.maxConnCompCount, param.minConnCompArea, param.maxConnCompArea,
+        param.boundingRegionScale, param.minMSERCount, param.minFilteredCompCount, param.maxDownscale,
+    };
+
+    float float_fields[] = {
+        param.minEccentricity, param.maxEccentricity, param.minSolidity, param.maxStdDevMeanRatio,
+        param.minEdgeDensity, param.degradeRatio, param.expectedMsPerMegapixel,
+    };
+
+    unsigned long long h = hashBytes( int_fields, sizeof(int_fields) );
+    return hashBytes( float_fields, sizeof(float_fields), h );
+}
+
+/**
+ * Look the key up in memory first, then on disk (if there's a directory). Disk hits are promoted to memory.
+ * Decoding the mask costs a full frame, so callers that only need the rect and text can skip it
+ */
+bool ResultCache::get( unsigned long long key, CachedResult& result, bool with_mask ) {
+    Shard& shard = shardFor( key );
+
+    {
+        lock_guard<mutex> lock( shard.lock );
+        auto found = shard.index.find( key );
+        if( found != shard.index.end() ) {
+            /* Move to the front, as the most recently used */
+            shard.entries.splice( shard.entries.begin(), shard.entries, found->second );
+            decode( found->second->second, result, with_mask );
+            return true;
+        }
+    }
+
+    Entry entry;
+    if( directory.empty() || !readFromDisk( key, entry ) )
+        return false;
+
+    decode( entry, result, with_mask );
+    insert( key, entry );
+    return true;
+}
+
+void ResultCache::put( unsigned long long key, const CachedResult& result ) {
+    Entry entry;
+    encode( result, entry );
+
+    insert( key, entry );
+
+    if( !directory.empty() )
+        writeToDisk( key, entry );
+}
+
+/**
+ * Run length encode the mask, treating every non zero pixel as foreground
+ */
+void ResultCache::encode( const CachedResult& result, Entry& entry ) {
+    entry.rect = result.rect;
+    entry.size = result.mask.size();
+    entry.text = result.text;
+    entry.runs.clear();
+
+    if( result.mask.empty() )
+        return;
+
+    CV_Assert( result.mask.type() == CV_8UC1 );
+
+    bool foreground   = false;
+    unsigned int run  = 0;
+    for( int y = 0; y < result.mask.rows; y++ ) {
+        const uchar * ptr = result.mask.ptr<uchar>(y);
+
+        for( int x = 0; x < result.mask.cols; x++ ) {
+            if( (ptr[x] != 0) != foreground ) {
+                entry.runs.push_back( run );
+                foreground = !foreground;
+                run = 0;
+            }
+            run++;
+        }
+    }
+    entry.runs.push_back( run );
+}
+
+void ResultCache::decode( const Entry& entry, CachedResult& result, bool with_mask ) {
+    result.rect = entry.rect;
+    result.text = entry.text;
+    result.mask = Mat();
+
+    if( !with_mask )
+        return;
+
+    result.mask = Mat( entry.size, CV_8UC1, Scalar(0) );
+
+    if( entry.runs.empty() )
+        return;
+
+    /* Freshly allocated, so it's continuous */
+    uchar * ptr = result.mask.ptr<uchar>(0);
+    uchar * end = ptr + result.mask.total();
+
+    bool foreground = false;
+    for( unsigned int run: entry.runs ) {
+        run = static_cast<unsigned int>( min( static_cast<size_t>( run ), static_cast<size_t>( end - ptr ) ) );
+        if( foreground )
+            memset( ptr, 255, run );
+
+        ptr += run;
+        foreground = !foreground;
+    }
+}
+
+ResultCache::Shard& ResultCache::shardFor( unsigned long long key ) {
+    return *shards[ ((key >> 32) ^ key) % shards.size() ];
+}
+
+/**
+ * Insert (or refresh) the entry as the most recently used, evicting the least recently used if full
+ */
+void ResultCache::insert( unsigned long long key, const Entry& entry ) {
+    Shard& shard = shardFor( key );
+    lock_guard<mutex> lock( shard.lock );
+
+    auto found = shard.index.find( key );
+    if( found != shard.index.end() ) {
+        found->second->second = entry;
+        shard.entries.splice( shard.entries.begin(), shard.entries, found->second );
+        return;
+    }
+
+    shard.entries.push_front( make_pair( key, entry ) );
+    shard.index[key] = shard.entries.begin();
+
+    if( shard.entries.size() > capacityPerShard ) {
+        shard.index.erase( shard.entries.back().first );
+        shard.entries.pop_back();
+    }
+}
+
+string ResultCache::pathFor( unsigned long long key ) const {
+    char name[32];
+    snprintf( name, sizeof(name), "%016llx.rtdc", key );
+    return directory + "/" + name;
+}
+
+/**
+ * Layout (native byte order):
+ *   char[4] magic, uint32 version,
+ *   int32 x, y, width, height, int32 rows, cols,
+ *   uint32 no of runs, uint32 runs[],
+ *   uint32 text length, char text[]
+ */
+bool ResultCache::readFromDisk( unsigned long long key, Entry& entry ) const {
+    string path = pathFor( key );
+
+    ifstream input( path.c_str(), ios::binary );
+    if( !input.is_open() )
+        return false;
+
+    /* Corrupt or truncated entries are misses, and removed so we don't trip over them again */
+    if( !readEntry( input, entry ) ) {
+        input.close();
+        remove( path.c_str() );
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Nothing in the file is trusted, sizes are checked against the sanity limits
+ * and against what's actually left in the file before anything is allocated
+ */
+bool ResultCache::readEntry( istream& input, Entry& entry ) {
+    input.seekg( 0, ios::end );
+    long long file_size = static_cast<long long>( input.tellg() );
+    input.seekg( 0, ios::beg );
+
+    char magic[4];
+    unsigned int version;
+    int header[6];
+    input.read( magic, sizeof(magic) );
+    input.read( reinterpret_cast<char *>( &version ), sizeof(version) );
+    input.read( reinterpret_cast<char *>( header ), sizeof(header) );
+
+    if( !input || memcmp( magic, CACHE_MAGIC, sizeof(magic) ) != 0 || version != CACHE_VERSION )
+        return false;
+
+    /* Either no mask at all, or a sensibly sized one */
+    int rows = header[4], cols = header[5];
+    bool no_mask = rows == 0 && cols == 0;
+    if( !no_mask && (rows <= 0 || cols <= 0 || rows > MAX_DIMENSION || cols > MAX_DIMENSION) )
+        return false;
+
+    entry.rect = Rect( header[0], header[1], header[2], header[3] );
+    entry.size = Size( cols, rows );
+    unsigned long long area = static_cast<unsigned long long>( rows ) * cols;
+
+    unsigned int run_count = 0;
+    input.read( reinterpret_cast<char *>( &run_count ), sizeof(run_count) );
+    if( !input || run_count > area + 1 )
+        return false;
+
+    long long remaining = file_size - static_cast<long long>( input.tellg() );
+    if( static_cast<long long>( run_count ) * static_cast<long long>( sizeof(unsigned int) ) > remaining )
+        return false;
+
+    entry.runs.resize( run_count );
+    input.read( reinterpret_cast<char *>( entry.runs.data() ), run_count * sizeof(unsigned int) );
+
+    /* The runs have to cover the mask exactly */
+    unsigned long long total = 0;
+    for( unsigned int run: entry.runs )
+        total += run;
+    if( !input || total != area )
+        return false;
+
+    unsigned int text_length = 0;
+    input.read( reinterpret_cast<char *>( &text_length ), sizeof(text_length) );
+    if( !input || text_length > MAX_TEXT_LENGTH )
+        return false;
+
+    remaining = file_size - static_cast<long long>( input.tellg() );
+    if( static_cast<long long>( text_length ) > remaining )
+        return false;
+
+    entry.text.resize( text_length );
+    if( text_length > 0 )
+        input.read( &entry.text[0], text_length );
+    return static_cast<bool>( input );
+}
+
+/**
+ * Written to a temporary file first and renamed into place,
+ * so concurrent readers never see a half written entry
+ */
+bool ResultCache::writeToDisk( unsigned long long key, const Entry& entry ) const {
+    string path = pathFor( key );
+
+    stringstream temp_path;
+    temp_path << path << ".tmp." << this_thread::get_id();
+
+    {
+        ofstream output( temp_path.str().c_str(), ios::binary );
+        if( !output.is_open() )
+            return false;
+
+        int header[6] = {
+            entry.rect.x, entry.rect.y, entry.rect.width, entry.rect.height,
+            entry.size.height, entry.size.width,
+        };
+        unsigned int run_count   = static_cast<unsigned int>( entry.runs.size() );
+        unsigned int text_length = static_cast<unsigned int>( entry.text.size() );
+
+        output.write( CACHE_MAGIC, sizeof(CACHE_MAGIC) );
+        output.write( reinterpret_cast<const char *>( &CACHE_VERSION ), sizeof(CACHE_VERSION) );
+        output.write( reinterpret_cast<const char *>( header ), sizeof(header) );
+        output.write( reinterpret_cast<const char *>( &run_count ), sizeof(run_count) );
+        output.write( reinterpret_cast<const char *>( entry.runs.data() ), run_count * sizeof(unsigned int) );
+        output.write( reinterpret_cast<const char *>( &text_length ), sizeof(text_length) );
+        output.write( entry.text.data(), text_length );
+
+        if( !output ) {
+            remove( temp_path.str().c_str() );
+            return false;
+        }
+    }
+
+    return rename( temp_path.str().c_str(), path.c_str() ) == 0;
+}
@@ -0,0 +1,81 @@
+//
+//  ResultCache.h
+//  RobustTextDetection
+//
+
+#ifndef __RobustTextDetection__ResultCache__
+#define __RobustTextDetection__ResultCache__
+
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <opencv2/opencv.hpp>
+
+#include "RobustTextDetection.h"
+
+/**
+ * Result of detection + OCR on a single image, as kept in the cache
+ */
+struct CachedResult {
+    cv::Rect rect;
+    cv::Mat mask;       /* the filtered stroke width, 0 or 255 */
+    std::string text;
+};
+
+
+/**
+ * Cache of detection results keyed by the content of the image and the parameters used, so that
+ * exact duplicates (re-uploads, retries, repeated video frames) don't go thru the pipeline again.
+ *
+ * The in-memory tier is an LRU bounded by the number of entries, split into independently locked
+ * shards so that many workers can use it at once. Optionally, entries are also written to a directory
+ * in a compact binary format (the mask is run length encoded), and looked up there on a memory miss.
+ */
+class ResultCache {
+public:
+    ResultCache( size_t capacity = 1024, const std::string& directory = "", int shard_count = 16 );
+    virtual ~ResultCache();
+
+    static unsigned long long hashImage( const cv::Mat& image );
+    static unsigned long long hashParam( const RobustTextParam& param );
+    static unsigned long long hashBytes( const void * data, size_t size, unsigned long long seed = 0 );
+    static unsigned long long combine( unsigned long long a, unsigned long long b );
+
+    bool get( unsigned long long key, CachedResult& result, bool with_mask = true );
+    void put( unsigned long long key, const CachedResult& result );
+
+protected:
+    /* Compact form of a result, the mask is stored as alternating runs of 0 and 255, starting with 0 */
+    struct Entry {
+        cv::Rect rect;
+        cv::Size size;
+        std::vector<unsigned int> runs;
+        std::string text;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::list<std::pair<unsigned long long, Entry>> entries;
+        std::unordered_map<unsigned long long, std::list<std::pair<unsigned long long, Entry>>::iterator> index;
+    };
+
+    static void encode( const CachedResult& result, Entry& entry );
+    static void decode( const Entry& entry, CachedResult& result, bool with_mask );
+
+    Shard& shardFor( unsigned long long key );
+    void insert( unsigned long long key, const Entry& entry );
+
+    std::string pathFor( unsigned long long key ) const;
+    bool readFromDisk( unsigned long long key, Entry& entry ) const;
+    static bool readEntry( std::istream& input, Entry& entry );
+    bool writeToDisk( unsigned long long key, const Entry& entry ) const;
+
+private:
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t capacityPerShard;
+    std::string directory;
+};
+
+#endif /* defined(__RobustTextDetection__ResultCache__) */
@@ -8,18 +8,22 @@
 
 #include "RobustTextDetection.h"
 #include "ConnectedComponent.h"
-
-#include <numeric>
+#include "TraceRecorder.h"
 
 using namespace std;
 using namespace cv;
 
-RobustTextDetection::RobustTextDetection(string temp_img_directory) {
+RobustTextDetection::RobustTextDetection(string temp_img_directory)
+: tempImageDirectory( temp_img_directory ) {
+}
+
+RobustTextDetection::RobustTextDetection(const RobustTextParam & param, string temp_img_directory)
+: tempImageDirectory( temp_img_directory ),
+param( param ) {
 }
 
-RobustTextDetection::RobustTextDetection(RobustTextParam & param, string temp_img_directory) {
-    this->param                 = param;
-    this->tempImageDirectory    = temp_img_directory;
+const RobustTextParam& RobustTextDetection::getParam() const {
+    return param;
 }
 
 /**
@@ -27,24 +31,97 @@ RobustTextDetection::RobustTextDetection(RobustTextParam & param, string temp_im
  * It returns the filtered stroke width image which contains the possible
  * text in binary format, and also the rect
  **/
-pair<Mat, Rect> RobustTextDetection::apply( Mat& image ) {
+pair<Mat, Rect> RobustTextDetection::apply( const Mat& image ) const {
+    RobustTextReport report;
+    return apply( image, report );
+}
+
+/**
+ * Same as above, but also fills up the report on how the run went.
+ * If any of the early exit checks triggers, an empty mask and rect are returned right away.
+ *
+ * If a time budget (in ms) is given, cheaper options are switched on as soon as the budget looks
+ * to be at risk, the report tells which of them were applied
+ **/
+pair<Mat, Rect> RobustTextDetection::apply( const Mat& image, RobustTextReport& report, double budget ) const {
+    int64 start_tick = getTickCount();
+    report = RobustTextReport();
+    
+    auto elapsed = [&]() {
+        return (getTickCount() - start_tick) * 1000.0 / getTickFrequency();
+    };
+    
+    /* Past this point of the budget, the remaining stages should take the cheaper route */
+    auto at_risk = [&]() {
+        return budget > 0.0 && elapsed() > budget * param.degradeRatio;
+    };
+    
+    /* Bail out with nothing found, and note down where we stopped */
+    auto early_exit = [&]( RobustTextReport::EarlyExit reason ) {
+        report.earlyExit = reason;
+        report.elapsed   = elapsed();
+        return pair<Mat, Rect>( Mat( image.size(), CV_8UC1, Scalar(0) ), Rect() );
+    };
+    
+    /* Every stage is traced, and profiled with hardware counters when asked for */
+    TraceSpan span( "preprocess" );
+    StageProfiler profiler( report.stages, param.profileStages );
+    profiler.next( "preprocess" );
+    
+    auto next_stage = [&]( const char * name ) {
+        span.next( name );
+        profiler.next( name );
+    };
+    
+    report.megapixels = image.total() / 1.0e6;
     Mat grey      = preprocessImage( image );
-    Mat mser_mask = createMSERMask( grey );
+    
+    /* If the image is expected to blow the budget right from the start, work on a smaller one */
+    int scale = 1;
+    double expected = report.megapixels * param.expectedMsPerMegapixel;
+    if( budget > 0.0 && expected > budget ) {
+        /* maxDownscale of 0 or 1 means never downscale */
+        scale = max( 1, min( static_cast<int>( ceil( sqrt( expected / budget ) ) ), param.maxDownscale ) );
+        
+        if( scale > 1 ) {
+            Mat downscaled;
+            resize( grey, downscaled, Size( (grey.cols + scale - 1) / scale, (grey.rows + scale - 1) / scale ), 0, 0, INTER_AREA );
+            grey = downscaled;
+            report.degradations |= RobustTextReport::DEGRADE_DOWNSCALE;
+        }
+    }
+    
+    /* Area thresholds are in pixels of the original image */
+    const int area_scale = scale * scale;
+    
+    next_stage( "mser" );
+    Mat mser_mask = createMSERMask( grey, param.minMSERArea / area_scale, param.maxMSERArea / area_scale, report.mserCount );
+    
+    if( report.mserCount < param.minMSERCount )
+        return early_exit( RobustTextReport::EXIT_MSER_COUNT );
     
     
     /* Perform canny edge operator to extract the edges */
+    next_stage( "canny" );
     Mat edges;
     Canny( grey, edges, param.cannyThresh1, param.cannyThresh2 );
     
+    report.edgeDensity = static_cast<float>( countNonZero( edges ) ) / edges.total();
+    if( report.edgeDensity < param.minEdgeDensity )
+        return early_exit( RobustTextReport::EXIT_EDGE_DENSITY );
     
-    /* Create the edge enhanced MSER region */
-    Mat edge_mser_intersection  = edges & mser_mask;
-    Mat gradient_grown          = growEdges( grey, edge_mser_intersection );
-    Mat edge_enhanced_mser      = ~gradient_grown & mser_mask;
+    
+    /* Create the edge enhanced MSER region, in one sweep instead of going thru the intermediate masks */
+    next_stage( "edge_enhanced_mser" );
+    Mat grad_dir                = computeGradientDirections( grey );
+    Mat edge_enhanced_mser      = createEdgeEnhancedMSER( edges, mser_mask, grad_dir );
     
     /* Writing temporary output images */
     if( !tempImageDirectory.empty() ) {
         cout << "Writing temp output images" << endl;
+        Mat edge_mser_intersection  = edges & mser_mask;
+        Mat gradient_grown          = growEdges( grad_dir, edge_mser_intersection );
+        
         imwrite( tempImageDirectory + "/out_grey.png",                   grey );
         imwrite( tempImageDirectory + "/out_mser_mask.png",              mser_mask );
         imwrite( tempImageDirectory + "/out_canny_edges.png",            edges );
@@ -54,15 +131,27 @@ pair<Mat, Rect> RobustTextDetection::apply( Mat& image ) {
     }
     
     /* Find the connected components */
-    ConnectedComponent conn_comp( param.maxConnCompCount, 4);
-    Mat labels = conn_comp.apply( edge_enhanced_mser );
-    vector<ComponentProperty> props = conn_comp.getComponentsProperties();
+    next_stage( "component_filter" );
+    bool compute_solidity = true;
+    if( at_risk() ) {
+        compute_solidity = false;
+        report.degradations |= RobustTextReport::DEGRADE_SKIP_SOLIDITY;
+    }
+    
+    ConnectedComponent conn_comp( param.maxConnCompCount, 4, compute_solidity );
+    vector<ComponentProperty> props;
+    Mat labels = conn_comp.apply( edge_enhanced_mser, props );
     
     
-    Mat result( labels.size(), CV_8UC1, Scalar(0));
+    /* Labels are assigned sequentially, so a lookup table indexed by label tells which components are kept */
+    int max_label = 0;
+    for( ComponentProperty& prop: props )
+        max_label = max( max_label, prop.labelID );
+    
+    vector<uchar> keep( max_label + 1, 0 );
     for( ComponentProperty& prop: props ) {
         /* Filtered out connected components that aren't within the criteria */
-        if( prop.area < param.minConnCompArea || prop.area > param.maxConnCompArea )
+        if( prop.area < param.minConnCompArea / area_scale || prop.area > param.maxConnCompArea / area_scale )
             continue;
         
         if( prop.eccentricity < param.minEccentricity || prop.eccentricity > param.maxEccentricity )
@@ -71,80 +160,126 @@ pair<Mat, Rect> RobustTextDetection::apply( Mat& image ) {
         if( prop.solidity < param.minSolidity )
             continue;
         
-        result |= (labels == prop.labelID);
+        keep[prop.labelID] = 255;
+        report.componentCount++;
+    }
+    
+    if( report.componentCount < param.minFilteredCompCount )
+        return early_exit( RobustTextReport::EXIT_COMPONENT_COUNT );
+    
+    Mat result( labels.size(), CV_8UC1 );
+    for( int y = 0; y < labels.rows; y++ ) {
+        const int * label_ptr = labels.ptr<int>(y);
+        uchar * result_ptr    = result.ptr<uchar>(y);
+        
+        for( int x = 0; x < labels.cols; x++ )
+            result_ptr[x] = keep[ label_ptr[x] ];
     }
     
 
     /* Calculate the distance transformed from the connected components */
-    cv::distanceTransform( result, result, CV_DIST_L2, 3 );
+    next_stage( "distance_transform" );
+    int distance_type = CV_DIST_L2;
+    if( at_risk() ) {
+        distance_type = CV_DIST_L1;
+        report.degradations |= RobustTextReport::DEGRADE_L1_DISTANCE;
+    }
+    cv::distanceTransform( result, result, distance_type, 3 );
     result.convertTo( result, CV_32SC1 );
     
     /* Find the stroke width image from the distance transformed */
+    next_stage( "stroke_width" );
     Mat stroke_width = computeStrokeWidth( result );
     
-    /* Filter the stroke width using connected component again */
-    conn_comp   = ConnectedComponent( param.maxConnCompCount, 4);
-    labels      = conn_comp.apply( stroke_width );
-    props       = conn_comp.getComponentsProperties();
-    
-    Mat filtered_stroke_width( stroke_width.size(), CV_8UC1, Scalar(0) );
-    
-    for( ComponentProperty& prop: props ) {
-        Mat mask = labels == prop.labelID;
-        Mat temp;
-        stroke_width.copyTo( temp, mask );
+    /* Filter the stroke width per connected component.
+     * There's no need to label again: every pixel of the kept components has a distance of at least 1,
+     * the stroke width only propagates values within those pixels, and two kept components are never
+     * 4-connected to each other (otherwise they'd have been one component). So the labeling of the
+     * stroke width would give back exactly the same partition, and the first pass labels are reused */
+    next_stage( "stroke_width_filter" );
+    vector<int> counts( max_label + 1, 0 );
+    vector<double> sums( max_label + 1, 0.0 ), square_sums( max_label + 1, 0.0 );
+    
+    for( int y = 0; y < labels.rows; y++ ) {
+        const int * label_ptr  = labels.ptr<int>(y);
+        const int * stroke_ptr = stroke_width.ptr<int>(y);
         
-        int area = countNonZero( temp );
-        
-        /* Since we only want to consider the connected component, ignore the zero pixels */
-        vector<int> vec = Mat( temp.reshape( 1, temp.rows * temp.cols ) );
-        vector<int> nonzero_vec;
-        copy_if( vec.begin(), vec.end(), back_inserter(nonzero_vec), [&](int val){
-            return val > 0;
-        });
+        for( int x = 0; x < labels.cols; x++ ) {
+            /* Since we only want to consider the connected component, ignore the zero pixels */
+            if( stroke_ptr[x] <= 0 || keep[ label_ptr[x] ] == 0 )
+                continue;
+            
+            counts[ label_ptr[x] ]++;
+            sums[ label_ptr[x] ]        += stroke_ptr[x];
+            square_sums[ label_ptr[x] ] += static_cast<double>( stroke_ptr[x] ) * stroke_ptr[x];
+        }
+    }
+    
+    for( int label = 1; label <= max_label; label++ ) {
+        if( keep[label] == 0 || counts[label] == 0 ) {
+            keep[label] = 0;
+            continue;
+        }
         
         /* Find mean and std deviation for the connected components */
-        double mean = std::accumulate( nonzero_vec.begin(), nonzero_vec.end(), 0.0 ) / area;
-        
-        double accum = 0.0;
-        for( int val: nonzero_vec )
-            accum += (val - mean) * (val - mean );
-        double std_dev = sqrt( accum / area );
+        double mean     = sums[label] / counts[label];
+        double variance = max( 0.0, square_sums[label] / counts[label] - mean * mean );
+        double std_dev  = sqrt( variance );
         
         /* Filter out those which are out of the prespecified ratio */
         if( (std_dev / mean) > param.maxStdDevMeanRatio  )
-            continue;
+            keep[label] = 0;
+    }
+    
+    /* Collect the filtered stroke width */
+    Mat filtered_stroke_width( stroke_width.size(), CV_8UC1 );
+    for( int y = 0; y < labels.rows; y++ ) {
+        const int * label_ptr  = labels.ptr<int>(y);
+        const int * stroke_ptr = stroke_width.ptr<int>(y);
+        uchar * filtered_ptr   = filtered_stroke_width.ptr<uchar>(y);
         
-        /* Collect the filtered stroke width */
-        filtered_stroke_width |= mask;
+        for( int x = 0; x < labels.cols; x++ )
+            filtered_ptr[x] = stroke_ptr[x] > 0 ? keep[ label_ptr[x] ] : 0;
     }
 
     /* Use morphological close and open to create a large connected bounding region from the filtered stroke width */
-    Mat bounding_region;
-    morphologyEx( filtered_stroke_width, bounding_region, MORPH_CLOSE, getStructuringElement( MORPH_ELLIPSE, Size(25, 25)) );
-    morphologyEx( bounding_region, bounding_region, MORPH_OPEN, getStructuringElement( MORPH_ELLIPSE, Size(7, 7)) );
-    
-    /* ... so that we can get an overall bounding rect */
-    Mat bounding_region_coord;
-    findNonZero( bounding_region, bounding_region_coord );
-    Rect bounding_rect = boundingRect( bounding_region_coord );
+    /* ... so that we can get an overall bounding rect, radii 12 and 3 correspond to the 25x25 and 7x7 ellipses */
+    next_stage( "bounding_region" );
+    int bounding_region_scale = param.boundingRegionScale;
+    if( at_risk() ) {
+        bounding_region_scale = max( 2, bounding_region_scale * 2 );
+        report.degradations |= RobustTextReport::DEGRADE_COARSE_BOUNDING_REGION;
+    }
+    Rect bounding_rect = findBoundingRect( filtered_stroke_width, max( 1, 12 / scale ), max( 1, 3 / scale ), bounding_region_scale );
     
     Mat bounding_mask( filtered_stroke_width.size(), CV_8UC1, Scalar(0) );
     Mat( bounding_mask, bounding_rect ) = 255;
     
-    /* Well, add some margin to the bounding rect */
-    bounding_rect = Rect( bounding_rect.tl() - Point(5, 5), bounding_rect.br() + Point(5, 5) );
-    bounding_rect = clamp( bounding_rect, image.size() );
-    
-    
     /* Well, discard everything outside of the bounding rectangle */
     filtered_stroke_width.copyTo( filtered_stroke_width, bounding_mask );
     
+    /* Back to the original resolution, if we've been working on a downscaled image */
+    if( scale > 1 ) {
+        Mat upscaled;
+        resize( filtered_stroke_width, upscaled, image.size(), 0, 0, INTER_NEAREST );
+        filtered_stroke_width = upscaled;
+        
+        bounding_rect = Rect( bounding_rect.x * scale, bounding_rect.y * scale, bounding_rect.width * scale, bounding_rect.height * scale );
+        bounding_rect = bounding_rect & Rect( 0, 0, image.cols, image.rows );
+    }
+    
+    /* Well, add some margin to the bounding rect */
+    if( bounding_rect.area() > 0 ) {
+        bounding_rect = Rect( bounding_rect.tl() - Point(5, 5), bounding_rect.br() + Point(5, 5) );
+        bounding_rect = clamp( bounding_rect, image.size() );
+    }
+    
+    report.elapsed = elapsed();
     return pair<Mat, Rect>( filtered_stroke_width, bounding_rect );
 }
 
 
-Rect RobustTextDetection::clamp( Rect& rect, Size size ) {
+Rect RobustTextDetection::clamp( Rect& rect, Size size ) const {
     Rect result = rect;
     
     if( result.x < 0 )
@@ -163,14 +298,79 @@ Rect RobustTextDetection::clamp( Rect& rect, Size size ) {
 }
 
 
+/**
+ * Morphological dilation with a disk of the given radius, done by thresholding the distance
+ * to the nearest foreground pixel, so the cost doesn't grow with the size of the disk
+ */
+Mat RobustTextDetection::dilateDisk( const Mat& mask, float radius ) {
+    Mat dist;
+    distanceTransform( ~mask, dist, CV_DIST_L2, CV_DIST_MASK_PRECISE );
+    return dist <= radius;
+}
+
+/**
+ * Morphological erosion with a disk of the given radius, a pixel survives when the
+ * nearest background pixel is further away than the radius
+ */
+Mat RobustTextDetection::erodeDisk( const Mat& mask, float radius ) {
+    Mat dist;
+    distanceTransform( mask, dist, CV_DIST_L2, CV_DIST_MASK_PRECISE );
+    return dist > radius;
+}
+
+/**
+ * Close then open the mask with disks of the given radii, to merge the text into one large
+ * connected region, and find its bounding rect from the row and column projections.
+ * If scale > 1, this is done on a mask downsampled by that factor, which is cheaper but
+ * only gives the boundary up to the scale factor
+ */
+Rect RobustTextDetection::findBoundingRect( const Mat& mask, int close_radius, int open_radius, int scale ) const {
+    Mat region = mask;
+    if( scale > 1 ) {
+        resize( mask, region, Size( (mask.cols + scale - 1) / scale, (mask.rows + scale - 1) / scale ), 0, 0, INTER_AREA );
+        region         = region > 0;
+        close_radius   = max( 1, close_radius / scale );
+        open_radius    = max( 1, open_radius  / scale );
+    }
+    
+    region = erodeDisk( dilateDisk( region, close_radius ), close_radius );
+    region = dilateDisk( erodeDisk( region, open_radius ), open_radius );
+    
+    /* The extent of the region is wherever the row / column maximums are non zero */
+    Mat col_proj, row_proj;
+    reduce( region, col_proj, 0, CV_REDUCE_MAX );
+    reduce( region, row_proj, 1, CV_REDUCE_MAX );
+    
+    const uchar * col_ptr = col_proj.ptr<uchar>(0);
+    int left = 0, right = region.cols - 1;
+    while( left <= right && col_ptr[left] == 0 )
+        left++;
+    while( right >= left && col_ptr[right] == 0 )
+        right--;
+    
+    int top = 0, bottom = region.rows - 1;
+    while( top <= bottom && row_proj.at<uchar>(top, 0) == 0 )
+        top++;
+    while( bottom >= top && row_proj.at<uchar>(bottom, 0) == 0 )
+        bottom--;
+    
+    if( left > right || top > bottom )
+        return Rect();
+    
+    Rect rect( left * scale, top * scale, (right - left + 1) * scale, (bottom - top + 1) * scale );
+    return rect & Rect( 0, 0, mask.cols, mask.rows );
+}
+
+
 /**
  * Create a mask out from the MSER components
  */
-Mat RobustTextDetection::createMSERMask( Mat& grey ) {
+Mat RobustTextDetection::createMSERMask( const Mat& grey, int min_area, int max_area, int& region_count ) const {
     /* Find MSER components */
     vector<vector<Point>> contours;
-    MSER mser( 8, param.minMSERArea, param.maxMSERArea, 0.25, 0.1, 100, 1.01, 0.03, 5 );
+    MSER mser( 8, max( 1, min_area ), max( 1, max_area ), 0.25, 0.1, 100, 1.01, 0.03, 5 );
     mser(grey, contours);
+    region_count = static_cast<int>( contours.size() );
     
     /* Create a binary mask out of the MSER */
     Mat mser_mask( grey.size(), CV_8UC1, Scalar(0));
@@ -187,8 +387,12 @@ Mat RobustTextDetection::createMSERMask( Mat& grey ) {
 /**
  * Preprocess image
  */
-Mat RobustTextDetection::preprocessImage( Mat& image ) {
+Mat RobustTextDetection::preprocessImage( const Mat& image ) const {
     /* TODO: Should do contrast enhancement here  */
+    /* Already grayscale (e.g. luma plane from a video stream), no need to copy it */
+    if( image.channels() == 1 )
+        return image;
+
     Mat grey;
     cvtColor( image, grey, CV_BGR2GRAY );
     return grey;
@@ -207,11 +411,10 @@ int RobustTextDetection::toBin( const float angle, const int neighbors ) {
 }
 
 /**
- * Grow the edges along with directon of gradient
+ * Find the direction of gradient of each pixel, encoded into our 3x3 neighborhood scheme (see toBin),
+ * 0 means there's no direction
  */
-Mat RobustTextDetection::growEdges(Mat& image, Mat& edges ) {
-    CV_Assert( edges.type() == CV_8UC1 );
-    
+Mat RobustTextDetection::computeGradientDirections( const Mat& image ) const {
     Mat grad_x, grad_y;
     Sobel( image, grad_x, CV_32FC1, 1, 0 );
     Sobel( image, grad_y, CV_32FC1, 0, 1 );
@@ -235,7 +438,15 @@ Mat RobustTextDetection::growEdges(Mat& image, Mat& edges ) {
     }
     grad_dir.convertTo( grad_dir, CV_8UC1 );
     
-    
+    return grad_dir;
+}
+
+/**
+ * Grow the edges along with directon of gradient
+ */
+Mat RobustTextDetection::growEdges( const Mat& grad_dir, const Mat& edges ) const {
+    CV_Assert( edges.type() == CV_8UC1 );
+    CV_Assert( grad_dir.type() == CV_8UC1 && grad_dir.size() == edges.size() );
     
     /* Perform region growing based on the gradient direction */
     Mat result = edges.clone();
@@ -244,9 +455,9 @@ Mat RobustTextDetection::growEdges(Mat& image, Mat& edges ) {
     uchar * curr_ptr = result.ptr<uchar>(1);
     
     for( int y = 1; y < edges.rows - 1; y++ ) {
-        uchar * edge_ptr = edges.ptr<uchar>(y);
-        uchar * grad_ptr = grad_dir.ptr<uchar>(y);
-        uchar * next_ptr = result.ptr<uchar>(y + 1);
+        const uchar * edge_ptr = edges.ptr<uchar>(y);
+        const uchar * grad_ptr = grad_dir.ptr<uchar>(y);
+        uchar * next_ptr       = result.ptr<uchar>(y + 1);
         
         for( int x = 1; x < edges.cols - 1; x++ ) {
             /* Only consider the contours */
@@ -275,10 +486,92 @@ Mat RobustTextDetection::growEdges(Mat& image, Mat& edges ) {
 }
 
 
+/**
+ * Is the pixel at x an edge within the MSER region, whose gradient points towards the given direction
+ */
+static inline bool isGrowingTowards( const uchar * edge_ptr, const uchar * mser_ptr, const uchar * dir_ptr, int x, uchar direction ) {
+    return edge_ptr[x] != 0 && mser_ptr[x] != 0 && dir_ptr[x] == direction;
+}
+
+/**
+ * Fused version of ~growEdges( grad_dir, edges & mser_mask ) & mser_mask, computed in a single
+ * sweep without any intermediate mask.
+ *
+ * growEdges scatters each edge pixel into the neighbor its gradient points to, which makes every
+ * row depend on the rows around it. Here it's turned around into a gather: an output pixel is grown
+ * if it's an edge itself, or if one of its 8 neighbors (within the same interior that growEdges
+ * works on) points at it. So every output pixel only reads its 3x3 neighborhood.
+ */
+Mat RobustTextDetection::createEdgeEnhancedMSER( const Mat& edges, const Mat& mser_mask, const Mat& grad_dir ) const {
+    CV_Assert( edges.type() == CV_8UC1 && mser_mask.type() == CV_8UC1 && grad_dir.type() == CV_8UC1 );
+    CV_Assert( edges.size() == mser_mask.size() && edges.size() == grad_dir.size() );
+    
+    const int rows = edges.rows;
+    const int cols = edges.cols;
+    
+    Mat result( edges.size(), CV_8UC1 );
+    
+    for( int y = 0; y < rows; y++ ) {
+        /* Only the interior rows [1, rows - 2] grow into their neighbors */
+        const bool has_prev = y - 1 >= 1;
+        const bool has_curr = y >= 1 && y <= rows - 2;
+        const bool has_next = y + 1 <= rows - 2;
+        
+        const uchar * edge_ptr      = edges.ptr<uchar>(y);
+        const uchar * mser_ptr      = mser_mask.ptr<uchar>(y);
+        const uchar * dir_ptr       = grad_dir.ptr<uchar>(y);
+        const uchar * prev_edge_ptr = edges.ptr<uchar>( max( y - 1, 0 ) );
+        const uchar * prev_mser_ptr = mser_mask.ptr<uchar>( max( y - 1, 0 ) );
+        const uchar * prev_dir_ptr  = grad_dir.ptr<uchar>( max( y - 1, 0 ) );
+        const uchar * next_edge_ptr = edges.ptr<uchar>( min( y + 1, rows - 1 ) );
+        const uchar * next_mser_ptr = mser_mask.ptr<uchar>( min( y + 1, rows - 1 ) );
+        const uchar * next_dir_ptr  = grad_dir.ptr<uchar>( min( y + 1, rows - 1 ) );
+        uchar * result_ptr          = result.ptr<uchar>(y);
+        
+        for( int x = 0; x < cols; x++ ) {
+            if( mser_ptr[x] == 0 ) {
+                result_ptr[x] = 0;
+                continue;
+            }
+            
+            /* Same neighborhood encoding as toBin, with the source pixel's position relative to us
+             | 2 | 3 | 4 |
+             | 1 | 0 | 5 |
+             | 8 | 7 | 6 |
+             e.g. the pixel on our right grows into us if it points to 1 */
+            const bool has_left  = x - 1 >= 1;
+            const bool has_mid   = x >= 1 && x <= cols - 2;
+            const bool has_right = x + 1 <= cols - 2;
+            
+            bool grown = edge_ptr[x] != 0;
+            
+            if( !grown && has_curr && has_right )
+                grown = isGrowingTowards( edge_ptr, mser_ptr, dir_ptr, x + 1, 1 );
+            
+            if( !grown && has_next ) {
+                grown = (has_right && isGrowingTowards( next_edge_ptr, next_mser_ptr, next_dir_ptr, x + 1, 2 )) ||
+                        (has_mid   && isGrowingTowards( next_edge_ptr, next_mser_ptr, next_dir_ptr, x    , 3 )) ||
+                        (has_left  && isGrowingTowards( next_edge_ptr, next_mser_ptr, next_dir_ptr, x - 1, 4 ));
+            }
+            
+            if( !grown && has_prev ) {
+                grown = (has_left  && isGrowingTowards( prev_edge_ptr, prev_mser_ptr, prev_dir_ptr, x - 1, 6 )) ||
+                        (has_mid   && isGrowingTowards( prev_edge_ptr, prev_mser_ptr, prev_dir_ptr, x    , 7 )) ||
+                        (has_right && isGrowingTowards( prev_edge_ptr, prev_mser_ptr, prev_dir_ptr, x + 1, 8 ));
+            }
+            
+            result_ptr[x] = grown ? 0 : 255;
+        }
+    }
+    
+    return result;
+}
+
+
 /**
  * Convert from our encoded 8 bit uchar to the (8) neighboring coordinates
  */
-vector<Point> RobustTextDetection::convertToCoords( int x, int y, bitset<8> neighbors ) {
+vector<Point> RobustTextDetection::convertToCoords( int x, int y, bitset<8> neighbors ) const {
     vector<Point> coords;
     
     if( neighbors[0] ) coords.push_back( Point(x - 1, y    ) );
@@ -296,14 +589,14 @@ vector<Point> RobustTextDetection::convertToCoords( int x, int y, bitset<8> neig
 /**
  * Overloaded function for convertToCoords
  */
-vector<Point> RobustTextDetection::convertToCoords( Point& coord, bitset<8> neighbors ) {
+vector<Point> RobustTextDetection::convertToCoords( Point& coord, bitset<8> neighbors ) const {
     return convertToCoords( coord.x, coord.y, neighbors );
 }
 
 /**
  * Overloaded function for convertToCoords
  */
-vector<Point> RobustTextDetection::convertToCoords( Point& coord, uchar neighbors ) {
+vector<Point> RobustTextDetection::convertToCoords( Point& coord, uchar neighbors ) const {
     return convertToCoords( coord.x, coord.y, bitset<8>(neighbors) );
 }
 
@@ -313,7 +606,7 @@ vector<Point> RobustTextDetection::convertToCoords( Point& coord, uchar neighbor
  * | 1 | 0 | 5 |
  * | 8 | 7 | 6 |
  */
-inline bitset<8> RobustTextDetection::getNeighborsLessThan( int * curr_ptr, int x, int * prev_ptr, int * next_ptr ) {
+inline bitset<8> RobustTextDetection::getNeighborsLessThan( int * curr_ptr, int x, int * prev_ptr, int * next_ptr ) const {
     bitset<8> neighbors;
     neighbors[0] = curr_ptr[x-1] == 0 ? 0 : curr_ptr[x-1] < curr_ptr[x];
     neighbors[1] = prev_ptr[x-1] == 0 ? 0 : prev_ptr[x-1] < curr_ptr[x];
@@ -333,7 +626,7 @@ inline bitset<8> RobustTextDetection::getNeighborsLessThan( int * curr_ptr, int
  * It will propagate the max values of each connected component from the ridge
  * to outer boundaries
  **/
-Mat RobustTextDetection::computeStrokeWidth( Mat& dist ) {
+Mat RobustTextDetection::computeStrokeWidth( const Mat& dist ) const {
     /* Pad the distance transformed matrix to avoid boundary checking */
     Mat padded( dist.rows + 1, dist.cols + 1, dist.type(), Scalar(0) );
     dist.copyTo( Mat( padded, Rect(1, 1, dist.cols, dist.rows ) ) );
@@ -12,6 +12,8 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 
+#include "PerfCounters.h"
+
 using namespace std;
 using namespace cv;
 
@@ -32,6 +34,68 @@ struct RobustTextParam {
     float maxEccentricity    = 0.995;
     float minSolidity        = 0.4;
     float maxStdDevMeanRatio = 0.5;
+    
+    /* Downsample factor for building the bounding region, 1 keeps the exact boundaries */
+    int boundingRegionScale  = 1;
+    
+    /* Early exit thresholds, bail out as soon as there's nothing plausible left, 0 disables the check */
+    int minMSERCount         = 1;
+    float minEdgeDensity     = 0.0;
+    int minFilteredCompCount = 1;
+    
+    /* Measure each stage with hardware performance counters (Linux only) */
+    bool profileStages       = false;
+    
+    /* When running with a time budget: the fraction of the budget after which the remaining stages
+     * switch to cheaper options, and the expected cost used to decide whether to downscale up front */
+    float degradeRatio           = 0.5;
+    float expectedMsPerMegapixel = 250.0;
+    int maxDownscale             = 4;     /* 0 or 1 disables downscaling */
+};
+
+
+/**
+ * Book keeping of a single detection run, i.e. whether (and where) it exited early, and how long it took
+ */
+struct RobustTextReport {
+    enum EarlyExit {
+        EXIT_NONE = 0,
+        EXIT_MSER_COUNT,
+        EXIT_EDGE_DENSITY,
+        EXIT_COMPONENT_COUNT,
+    };
+    
+    /* Cheaper options taken to stay within the time budget, bitwise or-ed */
+    enum Degradation {
+        DEGRADE_NONE                    = 0,
+        DEGRADE_DOWNSCALE               = 1 << 0,
+        DEGRADE_SKIP_SOLIDITY           = 1 << 1,
+        DEGRADE_L1_DISTANCE             = 1 << 2,
+        DEGRADE_COARSE_BOUNDING_REGION  = 1 << 3,
+    };
+    
+    EarlyExit earlyExit  = EXIT_NONE;
+    int degradations     = DEGRADE_NONE;
+    double elapsed       = 0.0;     /* in milliseconds */
+    
+    int mserCount        = 0;
+    float edgeDensity    = 0.0;
+    int componentCount   = 0;
+    
+    double megapixels    = 0.0;
+    
+    /* Only filled up when RobustTextParam::profileStages is set */
+    std::vector<StageProfile> stages;
+    
+    friend std::ostream &operator <<( std::ostream& os, const RobustTextReport & report ) {
+        os << "   Early exit: " << report.earlyExit      << "\n";
+        os << "      Elapsed: " << report.elapsed        << " ms\n";
+        os << " Degradations: " << report.degradations   << "\n";
+        os << "   MSER count: " << report.mserCount      << "\n";
+        os << " Edge density: " << report.edgeDensity    << "\n";
+        os << "   Components: " << report.componentCount << "\n";
+        return os;
+    }
 };
 
 
@@ -45,28 +109,39 @@ struct RobustTextParam {
 class RobustTextDetection {
 public:
     RobustTextDetection( string temp_img_directory = "" );
-    RobustTextDetection( RobustTextParam& param, string temp_img_directory = "" );
+    RobustTextDetection( const RobustTextParam& param, string temp_img_directory = "" );
     
-    pair<Mat, Rect> apply( Mat& image );
+    /* The configuration is fixed after construction, and apply keeps all of its scratch state
+     * on the stack, so a single instance can be shared across threads without locking */
+    pair<Mat, Rect> apply( const Mat& image ) const;
+    pair<Mat, Rect> apply( const Mat& image, RobustTextReport& report, double budget = 0.0 ) const;
+    
+    const RobustTextParam& getParam() const;
     
 protected:
-    Mat preprocessImage( Mat& image );
-    Mat computeStrokeWidth( Mat& dist ) ;
-    Mat createMSERMask( Mat& grey );
+    Mat preprocessImage( const Mat& image ) const;
+    Mat computeStrokeWidth( const Mat& dist ) const;
+    Mat createMSERMask( const Mat& grey, int min_area, int max_area, int& region_count ) const;
     
     static int toBin( const float angle, const int neighbors = 8 );
-    Mat growEdges(Mat& image, Mat& edges );
+    Mat computeGradientDirections( const Mat& image ) const;
+    Mat growEdges( const Mat& grad_dir, const Mat& edges ) const;
+    Mat createEdgeEnhancedMSER( const Mat& edges, const Mat& mser_mask, const Mat& grad_dir ) const;
+    
+    vector<Point> convertToCoords( int x, int y, bitset<8> neighbors ) const;
+    vector<Point> convertToCoords( Point& coord, bitset<8> neighbors ) const;
+    vector<Point> convertToCoords( Point& coord, uchar neighbors ) const;
+    bitset<8> getNeighborsLessThan( int * curr_ptr, int x, int * prev_ptr, int * next_ptr ) const;
     
-    vector<Point> convertToCoords( int x, int y, bitset<8> neighbors ) ;
-    vector<Point> convertToCoords( Point& coord, bitset<8> neighbors ) ;
-    vector<Point> convertToCoords( Point& coord, uchar neighbors ) ;
-    bitset<8> getNeighborsLessThan( int * curr_ptr, int x, int * prev_ptr, int * next_ptr ) ;
+    Rect clamp( Rect& rect, Size size ) const;
     
-    Rect clamp( Rect& rect, Size size );
+    static Mat dilateDisk( const Mat& mask, float radius );
+    static Mat erodeDisk( const Mat& mask, float radius );
+    Rect findBoundingRect( const Mat& mask, int close_radius, int open_radius, int scale = 1 ) const;
     
 private:
-    string tempImageDirectory;
-    RobustTextParam param;
+    const string tempImageDirectory;
+    const RobustTextParam param;
 };
 
 #endif /* defined(__RobustTextDetection__RobustTextDetection__) */
@@ -0,0 +1,176 @@
+//
+//  TraceRecorder.cpp
+//  RobustTextDetection
+//
+
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <fstream>
+#include <unistd.h>
+
+using namespace std;
+
+/* Each thread's own buffer, and the image it's currently working on */
+static thread_local void * localBuffer   = NULL;
+static thread_local long long localImage = -1;
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::TraceRecorder()
+: enabled( false ),
+eventsPerThread( 0 ),
+startTime( 0 ) {
+}
+
+/**
+ * Write the trace out on exit, if it's been enabled
+ */
+TraceRecorder::~TraceRecorder() {
+    if( isEnabled() )
+        write();
+}
+
+/**
+ * Start recording, the trace will be written to output_path on exit.
+ * Each thread keeps up to events_per_thread events, the rest are dropped
+ */
+void TraceRecorder::enable( const string& output_path, size_t events_per_thread ) {
+    lock_guard<mutex> lock( registryMutex );
+    outputPath      = output_path;
+    eventsPerThread = events_per_thread;
+    startTime       = now();
+    enabled.store( true );
+}
+
+/**
+ * Tag the spans recorded by the calling thread with the given image id
+ */
+void TraceRecorder::setImageId( long long image_id ) {
+    localImage = image_id;
+}
+
+/**
+ * Monotonic time in microseconds
+ */
+long long TraceRecorder::now() {
+    return chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/**
+ * Append a span to the calling thread's buffer, only the owning thread ever writes to it
+ */
+void TraceRecorder::record( const char * name, long long begin, long long end ) {
+    ThreadBuffer * buffer = static_cast<ThreadBuffer *>( localBuffer );
+    if( buffer == NULL ) {
+        buffer      = registerThread();
+        localBuffer = buffer;
+    }
+
+    size_t index = buffer->count.load( memory_order_relaxed );
+    if( index >= buffer->events.size() ) {
+        buffer->dropped++;
+        return;
+    }
+
+    Event& event    = buffer->events[index];
+    event.name      = name;
+    event.begin     = begin;
+    event.end       = end;
+    event.imageId   = localImage;
+
+    /* Publish the event, so that write() on another thread sees it fully written */
+    buffer->count.store( index + 1, memory_order_release );
+}
+
+TraceRecorder::ThreadBuffer * TraceRecorder::registerThread() {
+    lock_guard<mutex> lock( registryMutex );
+
+    unique_ptr<ThreadBuffer> buffer( new ThreadBuffer() );
+    buffer->threadId = static_cast<int>( buffers.size() + 1 );
+    buffer->events.resize( eventsPerThread );
+    buffer->count.store( 0 );
+    buffer->dropped  = 0;
+
+    buffers.push_back( std::move( buffer ) );
+    return buffers.back().get();
+}
+
+/**
+ * Write all the recorded spans as Chrome trace-event JSON, using complete ("X") events
+ */
+bool TraceRecorder::write() {
+    lock_guard<mutex> lock( registryMutex );
+
+    ofstream output( outputPath.c_str() );
+    if( !output.is_open() ) {
+        cerr << "Unable to write trace to " << outputPath << endl;
+        return false;
+    }
+
+    int pid    = static_cast<int>( getpid() );
+    bool first = true;
+
+    output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for( unique_ptr<ThreadBuffer>& buffer: buffers ) {
+        size_t count = buffer->count.load( memory_order_acquire );
+
+        for( size_t i = 0; i < count; i++ ) {
+            const Event& event = buffer->events[i];
+
+            output  << (first ? "\n" : ",\n")
+                    << "{\"name\":\"" << event.name << "\",\"ph\":\"X\""
+                    << ",\"ts\":"  << (event.begin - startTime)
+                    << ",\"dur\":" << (event.end - event.begin)
+                    << ",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->threadId
+                    << ",\"args\":{\"image\":" << event.imageId << "}}";
+            first = false;
+        }
+
+        if( buffer->dropped > 0 )
+            cerr << "Trace buffer of thread " << buffer->threadId << " overflowed, dropped " << buffer->dropped << " events" << endl;
+    }
+    output << "\n]}\n";
+
+    return output.good();
+}
+
+
+TraceSpan::TraceSpan( const char * name )
+: name( NULL ),
+begin( 0 ) {
+    if( TraceRecorder::instance().isEnabled() ) {
+        this->name  = name;
+        this->begin = TraceRecorder::now();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    end();
+}
+
+/**
+ * Close the current span and open a new one right away
+ */
+void TraceSpan::next( const char * name ) {
+    if( this->name == NULL )
+        return;
+
+    long long time = TraceRecorder::now();
+    TraceRecorder::instance().record( this->name, begin, time );
+
+    this->name  = name;
+    this->begin = time;
+}
+
+void TraceSpan::end() {
+    if( name == NULL )
+        return;
+
+    TraceRecorder::instance().record( name, begin, TraceRecorder::now() );
+    name = NULL;
+}
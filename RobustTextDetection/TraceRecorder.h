@@ -0,0 +1,89 @@
+//
+//  TraceRecorder.h
+//  RobustTextDetection
+//
+
+#ifndef __RobustTextDetection__TraceRecorder__
+#define __RobustTextDetection__TraceRecorder__
+
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Records begin / end spans of the pipeline stages, and writes them out as Chrome trace-event JSON
+ * (viewable in chrome://tracing or Perfetto) when the process exits.
+ *
+ * Every thread appends to its own fixed size buffer, so recording never takes a lock, only the first
+ * span of each thread registers its buffer. When tracing is disabled, a span costs one relaxed load.
+ */
+class TraceRecorder {
+public:
+    static TraceRecorder& instance();
+    virtual ~TraceRecorder();
+
+    void enable( const std::string& output_path, size_t events_per_thread = 1 << 16 );
+    bool write();
+
+    inline bool isEnabled() const {
+        return enabled.load( std::memory_order_relaxed );
+    }
+
+    static void setImageId( long long image_id );
+    static long long now();
+
+    void record( const char * name, long long begin, long long end );
+
+protected:
+    TraceRecorder();
+
+    struct Event {
+        const char * name;
+        long long begin;
+        long long end;
+        long long imageId;
+    };
+
+    struct ThreadBuffer {
+        int threadId;
+        std::vector<Event> events;
+        std::atomic<size_t> count;
+        size_t dropped;
+    };
+
+    ThreadBuffer * registerThread();
+
+private:
+    std::atomic<bool> enabled;
+    std::string outputPath;
+    size_t eventsPerThread;
+    long long startTime;
+
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+
+/**
+ * Scoped span, that can also be moved on to the next stage of a sequential pipeline, e.g.
+ *   TraceSpan span( "mser" );
+ *   ...
+ *   span.next( "canny" );
+ * Names have to be string literals, only the pointer is kept
+ */
+class TraceSpan {
+public:
+    TraceSpan( const char * name );
+    ~TraceSpan();
+
+    void next( const char * name );
+    void end();
+
+private:
+    const char * name;
+    long long begin;
+};
+
+#endif /* defined(__RobustTextDetection__TraceRecorder__) */
@@ -7,18 +7,146 @@
 //
 
 #include <iostream>
+#include <fstream>
 #include <opencv2/opencv.hpp>
 #include <tesseract/baseapi.h>
 
 #include "RobustTextDetection.h"
 #include "ConnectedComponent.h"
+#include "FrameStreamReader.h"
+#include "DetectionServer.h"
+#include "TraceRecorder.h"
+
+#include <csignal>
 
 using namespace std;
 using namespace cv;
 
+static DetectionServer * server = NULL;
+
+static void handleStopSignal( int ) {
+    if( server != NULL )
+        server->requestStop();
+}
+
+/**
+ * Run the detection on every frame of a memory mapped Y4M / raw grayscale stream, and write
+ * "<frame index> <x> <y> <width> <height> <early exit> <elapsed ms>" per frame to the output file as we go.
+ * A frame that fails gets "<frame index> error <message>" instead, and the rest of the stream carries on
+ */
+int processStream( FrameStreamReader& reader, const RobustTextParam& param, const string& output_path ) {
+    ofstream output( output_path.c_str() );
+    if( !output.is_open() ) {
+        cerr << "Unable to open " << output_path << " for writing" << endl;
+        return 1;
+    }
+    
+    const RobustTextDetection detector( param );
+    
+    Mat luma;
+    RobustTextReport report;
+    
+    /* Per stage totals over the whole stream, when profiling */
+    vector<StageProfile> stage_totals;
+    double total_megapixels = 0.0;
+    
+    while( reader.next( luma ) ) {
+        TraceRecorder::setImageId( reader.getFrameIndex() - 1 );
+        
+        pair<Mat, Rect> result;
+        try {
+            result = detector.apply( luma, report );
+        }
+        catch( std::exception& e ) {
+            output << (reader.getFrameIndex() - 1) << " error " << e.what() << endl;
+            continue;
+        }
+        
+        total_megapixels += report.megapixels;
+        for( StageProfile& stage: report.stages ) {
+            auto total = find_if( stage_totals.begin(), stage_totals.end(), [&]( StageProfile& p ){
+                return string( p.name ) == stage.name;
+            });
+            
+            if( total == stage_totals.end() ) {
+                stage_totals.push_back( stage );
+                continue;
+            }
+            
+            total->elapsed += stage.elapsed;
+            for( int i = 0; i < PerfCounterValues::COUNT; i++ )
+                total->counters.values[i] += stage.counters.values[i];
+        }
+        
+        /* Flush per frame, so that partial results survive if we're interrupted hours into the footage */
+        output  << (reader.getFrameIndex() - 1) << " "
+                << result.second.x << " " << result.second.y << " "
+                << result.second.width << " " << result.second.height << " "
+                << report.earlyExit << " " << report.elapsed << endl;
+    }
+    
+    if( param.profileStages )
+        printStageProfiles( cerr, stage_totals, total_megapixels );
+    
+    return 0;
+}
+
 
 int main(int argc, const char * argv[])
 {
+    /* Optional Chrome trace-event output of every pipeline stage, written on exit */
+    const char * trace_path = getenv( "ROBUST_TEXT_TRACE" );
+    if( trace_path != NULL )
+        TraceRecorder::instance().enable( trace_path );
+    
+    /* Resident server mode: --serve <socket path> [no of workers] */
+    if( argc >= 3 && string( argv[1] ) == "--serve" ) {
+        RobustTextParam param;
+        DetectionServerParam server_param;
+        server_param.socketPath = argv[2];
+        if( argc >= 4 )
+            server_param.workerCount = atoi( argv[3] );
+        
+        DetectionServer detection_server( param, server_param );
+        if( !detection_server.start() )
+            return 1;
+        
+        /* Stop accepting on SIGINT / SIGTERM, but finish whatever is already queued */
+        server = &detection_server;
+        signal( SIGINT,  handleStopSignal );
+        signal( SIGTERM, handleStopSignal );
+        
+        detection_server.run();
+        server = NULL;
+        return 0;
+    }
+    
+    /* Offline batch mode over recorded footage:
+     *   --y4m <input.y4m> <output.txt>
+     *   --raw <input.raw> <width> <height> <output.txt>
+     */
+    if( argc >= 4 && string( argv[1] ) == "--y4m" ) {
+        FrameStreamReader reader;
+        if( !reader.openY4M( argv[2] ) ) {
+            cerr << "Unable to open " << argv[2] << endl;
+            return 1;
+        }
+        
+        RobustTextParam param;
+        param.profileStages = getenv( "ROBUST_TEXT_PROFILE" ) != NULL;
+        return processStream( reader, param, argv[3] );
+    }
+    else if( argc >= 6 && string( argv[1] ) == "--raw" ) {
+        FrameStreamReader reader;
+        if( !reader.openRaw( argv[2], atoi( argv[3] ), atoi( argv[4] ) ) ) {
+            cerr << "Unable to open " << argv[2] << endl;
+            return 1;
+        }
+        
+        RobustTextParam param;
+        param.profileStages = getenv( "ROBUST_TEXT_PROFILE" ) != NULL;
+        return processStream( reader, param, argv[5] );
+    }
 
     namedWindow( "" );
     moveWindow("", 0, 0);
@@ -41,23 +169,38 @@ int main(int argc, const char * argv[])
     param.minSolidity        = 0.4;
     param.maxStdDevMeanRatio = 0.5;
     
+    /* Set ROBUST_TEXT_PROFILE to get the per stage hardware counters */
+    param.profileStages      = getenv( "ROBUST_TEXT_PROFILE" ) != NULL;
+    
     /* Apply Robust Text Detection */
     /* ... remove this temp output path if you don't want it to write temp image files */
     string temp_output_path = "/Users/saburookita/Personal Projects/RobustTextDetection/";
     RobustTextDetection detector(param, temp_output_path );
-    pair<Mat, Rect> result = detector.apply( image );
+    RobustTextReport report;
+    pair<Mat, Rect> result = detector.apply( image, report );
+    
+    if( param.profileStages )
+        printStageProfiles( cerr, report.stages, report.megapixels );
     
     /* Get the region where the candidate text is */
     Mat stroke_width( result.second.height, result.second.width, CV_8UC1, Scalar(0) );
     Mat(result.first, result.second).copyTo( stroke_width);
     
     
-    /* Use Tesseract to try to decipher our image */
-    tesseract::TessBaseAPI tesseract_api;
-    tesseract_api.Init(NULL, "eng"  );
-    tesseract_api.SetImage((uchar*) stroke_width.data, stroke_width.cols, stroke_width.rows, 1, stroke_width.cols);
-    
-    string out = string(tesseract_api.GetUTF8Text());
+    /* Use Tesseract to try to decipher our image, unless no candidate text region was found at all */
+    string out;
+    if( result.second.area() > 0 ) {
+        TraceSpan ocr_span( "ocr" );
+        tesseract::TessBaseAPI tesseract_api;
+        tesseract_api.Init(NULL, "eng"  );
+        tesseract_api.SetImage((uchar*) stroke_width.data, stroke_width.cols, stroke_width.rows, 1, stroke_width.cols);
+        
+        char * text = tesseract_api.GetUTF8Text();
+        if( text != NULL ) {
+            out = text;
+            delete [] text;
+        }
+    }
 
     /* Split the string by whitespace */
     vector<string> splitted;
@@ -75,10 +218,13 @@ int main(int argc, const char * argv[])
     rectangle( image, result.second, Scalar(0, 0, 255), 2);
     
     /* Append the original and stroke width images together */
-    cvtColor( stroke_width, stroke_width, CV_GRAY2BGR );
-    Mat appended( image.rows, image.cols + stroke_width.cols, CV_8UC3 );
-    image.copyTo( Mat(appended, Rect(0, 0, image.cols, image.rows)) );
-    stroke_width.copyTo( Mat(appended, Rect(image.cols, 0, stroke_width.cols, stroke_width.rows)) );
+    Mat appended = image;
+    if( !stroke_width.empty() ) {
+        cvtColor( stroke_width, stroke_width, CV_GRAY2BGR );
+        appended = Mat( image.rows, image.cols + stroke_width.cols, CV_8UC3 );
+        image.copyTo( Mat(appended, Rect(0, 0, image.cols, image.rows)) );
+        stroke_width.copyTo( Mat(appended, Rect(image.cols, 0, stroke_width.cols, stroke_width.rows)) );
+    }
     
     imshow("", appended );
     waitKey();